@@ -0,0 +1,62 @@
+#pragma once
+
+#include "pch.h"
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+Class: BitVector
+A fixed-size set of small integers packed into 64-bit words.
+Used by the allocators for liveness sets and interference graphs.
+*/
+class BitVector {
+public:
+	BitVector(size_t n = 0) :n(n), words((n + 63) >> 6, 0) {}
+
+	size_t size() const { return n; }
+
+	bool test(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+	void set(size_t i) { words[i >> 6] |= (uint64_t)1 << (i & 63); }
+	void reset(size_t i) { words[i >> 6] &= ~((uint64_t)1 << (i & 63)); }
+	void clear() { std::fill(words.begin(), words.end(), 0); }
+
+	// this |= other, returns whether this changed
+	bool unionWith(const BitVector &other) {
+		uint64_t diff = 0;
+		for (size_t k = 0; k < words.size(); k++) {
+			diff |= other.words[k] & ~words[k];
+			words[k] |= other.words[k];
+		}
+		return diff != 0;
+	}
+	// this &= ~other
+	void subtract(const BitVector &other) {
+		for (size_t k = 0; k < words.size(); k++) words[k] &= ~other.words[k];
+	}
+
+	bool operator==(const BitVector &other) const { return words == other.words; }
+	bool operator!=(const BitVector &other) const { return words != other.words; }
+
+	// calls f(i) for every member i in increasing order
+	template<class F> void forEach(F f) const {
+		for (size_t k = 0; k < words.size(); k++)
+			for (uint64_t w = words[k]; w != 0; w &= w - 1)
+				f((k << 6) + lowestBit(w));
+	}
+
+private:
+	size_t n;
+	std::vector<uint64_t> words;
+
+	static size_t lowestBit(uint64_t w) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, w);
+		return index;
+#else
+		return __builtin_ctzll(w);
+#endif
+	}
+};
@@ -93,8 +93,11 @@ void CFGCleanUpPass::mergeBlockChain(std::shared_ptr<Function> f)
 			if (to_block != f->getEntry() && to_block->getBlocksFrom().size() == 1 && to_block != b) {
 				changed = true;
 				// merge to_block to  b
-				for (auto &bb : to_block->getBlocksTo()) bb->replaceBlockFrom(to_block, b);
 				b->remove_back();
+				for (auto &bb : to_block->getBlocksTo()) {
+					bb->replaceBlockFrom(to_block, b);
+					b->append_to(bb);
+				}
 				b->append_back(to_block->getFront());
 				b->setBack(to_block->getBack());
 				for (auto i = to_block->getFront(); i != nullptr; i = i->getNextInstr()) i->setBlock(b);
@@ -103,4 +106,5 @@ void CFGCleanUpPass::mergeBlockChain(std::shared_ptr<Function> f)
 			}
 		}
 	}
+	if (changed) updateDTinfo(f);  // drop the merged blocks from the block list
 }
@@ -101,6 +101,7 @@ void ConstantExpressionEvaluation::optimizeBinaryExpr(std::shared_ptr<Quadruple>
 	case Quadruple::MOD: {
 		if (y == 0) return;
 		result = x % y; 
+		break;
 	}
 	case Quadruple::LSHIFT: result = x << y; break;
 	case Quadruple::RSHIFT: result = x >> y; break;
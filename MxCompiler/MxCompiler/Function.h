@@ -6,6 +6,7 @@
 #include "basicblock.h"
 
 class DominatorTree;
+class LoopNest;
 
 /*
 Class: Function
@@ -47,6 +48,10 @@ public:
 	std::shared_ptr<DominatorTree> getDT() { return dt; }
 	void setDT(std::shared_ptr<DominatorTree> _dt) { dt = _dt; }
 
+	// built by LoopInvariantCodeMotion (c.f. loop.h)
+	std::shared_ptr<LoopNest> getLoopNest() { return loopNest; }
+	void setLoopNest(std::shared_ptr<LoopNest> _loopNest) { loopNest = _loopNest; }
+
 	void append_var(std::shared_ptr<VirtualReg> reg) { vars.insert(reg); }
 	std::set<std::shared_ptr<VirtualReg> > &getVars() { return vars; }
 
@@ -66,6 +71,7 @@ private:
 
 	//for SSA
 	std::shared_ptr<DominatorTree> dt;
+	std::shared_ptr<LoopNest> loopNest;
 	//return a list of block in this function module in DFS order on dominance tree;
 	std::vector<std::shared_ptr<BasicBlock> > blocks;
 	std::set<std::shared_ptr<VirtualReg> > vars;
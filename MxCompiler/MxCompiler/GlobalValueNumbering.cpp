@@ -0,0 +1,132 @@
+#include "GlobalValueNumbering.h"
+
+bool GlobalValueNumbering::run()
+{
+	changed = false;
+	for (auto &f : ir->getFunctions()) {
+		updateDTinfo(f);
+		available.clear();
+		leader.clear();
+		visit(f->getEntry(), MemoryState());
+	}
+	return changed;
+}
+
+void GlobalValueNumbering::visit(std::shared_ptr<BasicBlock> b, MemoryState memory)
+{
+	std::vector<Key> inserted;
+	for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+		if (i->getTag() == IRInstruction::QUADR) {
+			auto q = std::static_pointer_cast<Quadruple>(i);
+			auto op = q->getOp();
+			if (op == Quadruple::STORE) {
+				// no alias information, a store may overwrite any other location
+				memory.clear();
+				Key addr;
+				encode(addr, q->getDst());
+				memory[addr] = getLeader(q->getSrc1());
+			}
+			else if (op == Quadruple::MOVE)
+				leader[q->getDefReg()] = getLeader(q->getSrc1());
+			else if (op == Quadruple::LOAD) {
+				Key addr;
+				encode(addr, q->getSrc1());
+				auto it = memory.find(addr);
+				if (it != memory.end()) replaceByMove(i, q->getDefReg(), it->second);
+				else memory[addr] = q->getDefReg();
+			}
+			else {
+				Key key;
+				makeKey(q, key);
+				auto it = available.find(key);
+				if (it != available.end()) replaceByMove(i, q->getDefReg(), it->second);
+				else {
+					available[key] = q->getDefReg();
+					inserted.push_back(key);
+				}
+			}
+		}
+		else if (i->getTag() == IRInstruction::CALL) {
+			auto c = std::static_pointer_cast<Call>(i);
+			if (!ir->isPureBuiltin(c->getFunction())) {
+				memory.clear();
+				continue;
+			}
+			if (c->getResult() == nullptr) continue;
+			Key key;
+			makeKey(c, key);
+			auto it = available.find(key);
+			if (it != available.end()) replaceByMove(i, c->getDefReg(), it->second);
+			else {
+				available[key] = c->getDefReg();
+				inserted.push_back(key);
+			}
+		}
+	}
+
+	// what is known about memory still holds in a child entered only from this block
+	for (auto &child : b->getDTInfo().DEdges)
+		visit(child, child->getBlocksFrom().size() == 1 ? memory : MemoryState());
+
+	for (auto &key : inserted) available.erase(key);
+}
+
+void GlobalValueNumbering::makeKey(std::shared_ptr<Quadruple> q, Key &key)
+{
+	auto op = q->getOp();
+	auto src1 = q->getSrc1(), src2 = q->getSrc2();
+	if (op == Quadruple::GREATER || op == Quadruple::GEQ) {
+		op = op == Quadruple::GREATER ? Quadruple::LESS : Quadruple::LEQ;
+		std::swap(src1, src2);
+	}
+	Key lhs, rhs;
+	encode(lhs, src1);
+	if (src2 != nullptr) encode(rhs, src2);
+
+	bool commutative = op == Quadruple::ADD || op == Quadruple::TIMES || op == Quadruple::EQ ||
+		op == Quadruple::NEQ || op == Quadruple::BITAND || op == Quadruple::BITOR || op == Quadruple::BITXOR;
+	if (commutative && rhs < lhs) std::swap(lhs, rhs);
+
+	key.push_back(op);
+	key.insert(key.end(), lhs.begin(), lhs.end());
+	key.insert(key.end(), rhs.begin(), rhs.end());
+}
+
+void GlobalValueNumbering::makeKey(std::shared_ptr<Call> c, Key &key)
+{
+	key.push_back(-1);
+	key.push_back((long long)c->getFunction().get());
+	if (c->getObjRef() != nullptr) encode(key, c->getObjRef());
+	else key.push_back(-1);
+	for (auto &arg : c->getArgs()) encode(key, arg);
+}
+
+void GlobalValueNumbering::encode(Key &key, std::shared_ptr<Operand> op)
+{
+	op = getLeader(op);
+	if (op->category() == Operand::IMM) {
+		key.push_back(0);
+		key.push_back(std::static_pointer_cast<Immediate>(op)->getValue());
+	}
+	else {
+		key.push_back(1);
+		key.push_back((long long)op.get());
+	}
+}
+
+std::shared_ptr<Operand> GlobalValueNumbering::getLeader(std::shared_ptr<Operand> op)
+{
+	if (!Operand::isRegister(op->category())) return op;
+	auto it = leader.find(std::static_pointer_cast<Register>(op));
+	return it == leader.end() ? op : it->second;
+}
+
+void GlobalValueNumbering::replaceByMove(std::shared_ptr<IRInstruction> &i,
+	std::shared_ptr<Register> dst, std::shared_ptr<Operand> value)
+{
+	changed = true;
+	leader[dst] = value;
+	auto move = std::make_shared<Quadruple>(i->getBlock(), Quadruple::MOVE, dst, value);
+	replaceInstruction(i, move);
+	i = move;
+}
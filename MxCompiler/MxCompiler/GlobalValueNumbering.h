@@ -0,0 +1,41 @@
+#pragma once
+
+#include "cfg_pass.h"
+#include "IRinstruction.h"
+#include "IR.h"
+
+/*
+Dominator-tree scoped value numbering on SSA form.
+Quadruples and calls to the (pure) string builtins are hashed by their operator
+and the leaders of their operands, with commutative operands sorted and
+GREATER/GEQ flipped into LESS/LEQ. A computation that is already available in a
+dominating block is replaced by a MOVE from the earlier result, the copies are
+cleaned up by <ConstantExpressionEvaluation> afterwards.
+Loads are numbered as well, but only until the next store or impure call; the
+known memory values flow into a dominator tree child only when it has a single
+predecessor.
+*/
+class GlobalValueNumbering :public CFG_Pass {
+public:
+	GlobalValueNumbering(std::shared_ptr<IR> _ir) :CFG_Pass(_ir) {}
+
+	bool run() override;
+
+private:
+	using Key = std::vector<long long>;
+	using MemoryState = std::map<Key, std::shared_ptr<Operand> >;
+
+	bool changed;
+
+	std::map<Key, std::shared_ptr<Register> > available;
+	std::map<std::shared_ptr<Register>, std::shared_ptr<Operand> > leader;
+
+	void visit(std::shared_ptr<BasicBlock> b, MemoryState memory);
+
+	void makeKey(std::shared_ptr<Quadruple> q, Key &key);
+	void makeKey(std::shared_ptr<Call> c, Key &key);
+	void encode(Key &key, std::shared_ptr<Operand> op);
+	std::shared_ptr<Operand> getLeader(std::shared_ptr<Operand> op);
+
+	void replaceByMove(std::shared_ptr<IRInstruction> &i, std::shared_ptr<Register> dst, std::shared_ptr<Operand> value);
+};
@@ -30,6 +30,9 @@ public:
 		return n.length() > 7 && n.substr(0, 7) == "string.";
 	}
 
+	// builtins that only read their arguments (strings are immutable) and allocate the result
+	bool isPureBuiltin(std::shared_ptr<Function> f) { return isStringFunction(f) || f == toString; }
+
 	void setSSAflag(bool b) { _isSSA = b; }
 
 	bool isSSA() { return _isSSA; }
@@ -193,6 +193,16 @@ void PhiFunction::setDefReg(std::shared_ptr<Register> _defReg)
 	dst = _defReg;
 }
 
+std::shared_ptr<IRInstruction> PhiFunction::makeShadow(BasicBlockMap blockMap, OperandMap operandMap)
+{
+	auto shadow = std::make_shared<PhiFunction>(getOrDefault(blockMap, residingBlock),
+		std::static_pointer_cast<Register>(getOrDefault(operandMap, dst)));
+	for (auto &option : relatedReg)  // undefined options stay null
+		shadow->appendRelatedReg(std::static_pointer_cast<Register>(getOrDefault(operandMap, option.first)),
+			getOrDefault(blockMap, option.second));
+	return shadow;
+}
+
 void updateRegister(std::shared_ptr<Operand>& reg, std::map<std::shared_ptr<Register>, std::shared_ptr<Register>>& table)
 {
 	if (!Operand::isRegister(reg->category())) return;
@@ -311,6 +311,8 @@ public:
 	virtual std::shared_ptr<Register> getDefReg() override;
 	virtual void setDefReg(std::shared_ptr<Register> _defReg) override;
 
+	std::shared_ptr<IRInstruction>  makeShadow(BasicBlockMap blockMap, OperandMap operandMap) override;
+
 	ACCEPT_CFG_VISITOR
 private:
 	std::shared_ptr<Register> dst,origin;
@@ -0,0 +1,135 @@
+#include "LICM.h"
+
+bool LoopInvariantCodeMotion::run()
+{
+	changed = false;
+	for (auto &f : ir->getFunctions()) {
+		updateDTinfo(f);
+		auto nest = std::make_shared<LoopNest>(f);
+		bool created = false;
+		for (auto &l : nest->getLoopsInnermostFirst()) created |= insertPreheader(f, l);
+		if (created) {  // preheaders of inner loops belong to the outer ones
+			updateDTinfo(f);
+			nest = std::make_shared<LoopNest>(f);
+		}
+		f->setLoopNest(nest);
+
+		resolveDefineUseChain(f);
+		for (auto &l : nest->getLoopsInnermostFirst()) hoist(f, l);
+	}
+	return changed;
+}
+
+bool LoopInvariantCodeMotion::insertPreheader(std::shared_ptr<Function> f, std::shared_ptr<NaturalLoop> l)
+{
+	auto header = l->getHeader();
+	if (l->getPreheader() != nullptr || header == f->getEntry()) return false;
+
+	std::vector<std::shared_ptr<BasicBlock> > outside;
+	for (auto &p : header->getBlocksFrom())
+		if (!l->contains(p)) outside.push_back(p);
+	if (outside.empty()) return false;
+	changed = true;
+
+	auto preheader = std::make_shared<BasicBlock>(f, BasicBlock::PREHEADER);
+	for (auto &p : outside) {
+		if (p->getBack()->getTag() == IRInstruction::JUMP)
+			std::static_pointer_cast<Jump>(p->getBack())->setTarget(preheader);
+		else
+			std::static_pointer_cast<Branch>(p->getBack())->replaceTargetBlock(header, preheader);
+		p->replaceBlockTo(header, preheader);
+		preheader->append_from(p);
+		header->erase_from(p);
+	}
+
+	// the options coming from outside are merged in the preheader
+	auto isOutside = [&](const std::shared_ptr<BasicBlock> &b) {
+		return std::find(outside.begin(), outside.end(), b) != outside.end();
+	};
+	for (auto i = header->getFront(); i->getTag() == IRInstruction::PHI; i = i->getNextInstr()) {
+		auto phi = std::static_pointer_cast<PhiFunction>(i);
+		auto &options = phi->getRelatedRegs();
+		if (outside.size() == 1) {
+			for (auto &option : options)
+				if (option.second.lock() == outside[0]) option.second = preheader;
+			continue;
+		}
+
+		std::vector<std::pair<std::shared_ptr<Register>, std::weak_ptr<BasicBlock> > > kept, merged;
+		for (auto &option : options)
+			(isOutside(option.second.lock()) ? merged : kept).push_back(option);
+
+		std::shared_ptr<Register> value = merged.empty() ? nullptr : merged[0].first;
+		for (auto &option : merged)
+			if (option.first != value) {
+				value = std::make_shared<VirtualReg>();
+				auto newPhi = std::make_shared<PhiFunction>(preheader, value);
+				for (auto &o : merged) newPhi->appendRelatedReg(o.first, o.second.lock());
+				preheader->append_back(newPhi);
+				break;
+			}
+		options = kept;
+		phi->appendRelatedReg(value, preheader);
+	}
+	preheader->endWith(std::make_shared<Jump>(preheader, header));
+	return true;
+}
+
+void LoopInvariantCodeMotion::hoist(std::shared_ptr<Function> f, std::shared_ptr<NaturalLoop> l)
+{
+	auto preheader = l->getPreheader();
+	if (preheader == nullptr) return;
+
+	auto exiting = l->getExitingBlocks();
+	bool writesMemory = false;
+	for (auto &b : l->getBlocks())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr())
+			if ((i->getTag() == IRInstruction::QUADR && std::static_pointer_cast<Quadruple>(i)->getOp() == Quadruple::STORE)
+				|| (i->getTag() == IRInstruction::CALL && !ir->isPureBuiltin(std::static_pointer_cast<Call>(i)->getFunction())))
+				writesMemory = true;
+
+	// visiting the blocks in dominator tree order, the operands are hoisted before their users
+	for (auto &b : f->getBlockList()) {
+		if (!l->contains(b)) continue;
+		bool executedBeforeExit = !exiting.empty();
+		for (auto &e : exiting) executedBeforeExit &= f->getDT()->isDominating(b, e);
+
+		for (auto i = b->getFront(); i != nullptr; ) {
+			auto next = i->getNextInstr();
+			bool invariant = false;
+			if (i->getTag() == IRInstruction::QUADR) {
+				auto op = std::static_pointer_cast<Quadruple>(i)->getOp();
+				if (op == Quadruple::LOAD) invariant = !writesMemory && executedBeforeExit && isInvariant(i, l);
+				else if (op != Quadruple::STORE) invariant = isInvariant(i, l);
+			}
+			else if (i->getTag() == IRInstruction::CALL) {
+				auto c = std::static_pointer_cast<Call>(i);
+				invariant = ir->isPureBuiltin(c->getFunction()) && c->getResult() != nullptr
+					&& executedBeforeExit && isInvariant(i, l);
+			}
+
+			if (invariant) {
+				changed = true;
+				removeInstruction(i);
+				i->setBlock(preheader);
+				appendInstrBefore(preheader->getBack(), i);
+			}
+			i = next;
+		}
+	}
+}
+
+bool LoopInvariantCodeMotion::isInvariant(std::shared_ptr<Operand> op, std::shared_ptr<NaturalLoop> l)
+{
+	if (!Operand::isRegister(op->category())) return true;
+	auto it = def.find(std::static_pointer_cast<Register>(op));
+	// arguments, globals and static strings are defined out of every loop
+	return it == def.end() || !l->contains(it->second->getBlock());
+}
+
+bool LoopInvariantCodeMotion::isInvariant(std::shared_ptr<IRInstruction> i, std::shared_ptr<NaturalLoop> l)
+{
+	for (auto &reg : i->getUseRegs())
+		if (!isInvariant(reg, l)) return false;
+	return true;
+}
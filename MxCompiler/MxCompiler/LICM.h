@@ -0,0 +1,31 @@
+#pragma once
+
+#include "cfg_pass.h"
+#include "loop.h"
+
+/*
+Loop-invariant code motion on SSA form.
+Every loop gets a preheader (created when the header has several outside
+predecessors or the only one also branches elsewhere), then, innermost loops
+first, the invariant instructions are moved to the end of the preheader:
+	- quadruples other than LOAD/STORE whose operands are all defined out of the loop;
+	- LOADs from an invariant address, if the loop never writes memory
+	  (no STORE and no impure call) and the load is executed before any exit;
+	- calls to the pure builtins, again only when executed before any exit.
+The <LoopNest> is left on the function for later passes.
+*/
+class LoopInvariantCodeMotion : public CFG_Pass {
+public:
+	LoopInvariantCodeMotion(std::shared_ptr<IR> ir) :CFG_Pass(ir) {}
+
+	bool run() override;
+
+private:
+	bool changed;
+
+	bool insertPreheader(std::shared_ptr<Function> f, std::shared_ptr<NaturalLoop> l);
+	void hoist(std::shared_ptr<Function> f, std::shared_ptr<NaturalLoop> l);
+
+	bool isInvariant(std::shared_ptr<Operand> op, std::shared_ptr<NaturalLoop> l);
+	bool isInvariant(std::shared_ptr<IRInstruction> i, std::shared_ptr<NaturalLoop> l);
+};
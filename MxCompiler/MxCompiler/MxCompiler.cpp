@@ -2,18 +2,30 @@
 
 //#define SHOW_TOKENS
 
-void MxCompiler::compile(bool opt)
+MxCompiler::OptLevel MxCompiler::parseOptLevel(const std::string &flag)
 {
+	if (flag == "-O0") return O0;
+	if (flag == "-O1") return O1;
+	if (flag == "-O2") return O2;
+	if (flag == "-O3") return O3;
+	throw Error("unknown optimization level " + flag);
+}
+
+void MxCompiler::compile(OptLevel level, bool dumpIR)
+{
+	optLevel = level;
 	getCode();
 	parse();
 	buildAST();
 	semanticCheck();
 	generateIR();
-	if(opt) optimize();
+	if(optLevel != O0) optimize();
 
-	std::ofstream fout("ir.mxx");
-	printIR(fout);
-	fout.close();
+	if (dumpIR) {
+		std::ofstream fout("ir.mxx");
+		printIR(fout);
+		fout.close();
+	}
 
 	codegen();
 }
@@ -81,7 +93,6 @@ void MxCompiler::generateIR()
 	ir = irGenerator->getIR();
 
 	//printIR(std::cout);
-	//std::make_shared<FunctionInliner>(ir)->run();
 	//printIR(std::cerr);
 	std::make_shared<GlobalVarResolver>(ir)->run();
 
@@ -99,7 +110,7 @@ void MxCompiler::optimize()
 void MxCompiler::codegen()
 {
 	std::ofstream asmfile("test.s");
-	codeGenerator = std::make_shared<RISCVCodeGenerator>(ir, asmfile);
+	codeGenerator = std::make_shared<RISCVCodeGenerator>(ir, asmfile, optLevel < O2, optLevel == O3);
 	codeGenerator->generate();
 	codeGenerator->emit();
 	asmfile.close();
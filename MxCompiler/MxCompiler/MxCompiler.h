@@ -16,12 +16,25 @@
 
 class MxCompiler {
 public:
-	MxCompiler(std::string _fileName):fileName(_fileName){}
+	MxCompiler(std::string _fileName):fileName(_fileName), optLevel(O2){}
 	
-	void compile(bool opt = true);
+	/*
+	O0: no optimization
+	O1: optimized IR, linear scan register allocation (fast compiles)
+	O2: optimized IR, graph coloring register allocation
+	O3: O2 and instruction scheduling, for in-order cores
+	*/
+	enum OptLevel { O0, O1, O2, O3 };
+	// "-O0", "-O1", "-O2" or "-O3"
+	static OptLevel parseOptLevel(const std::string &flag);
+
+	// <dumpIR>: also print the IR to ir.mxx, which is only needed for debugging
+	void compile(OptLevel level = O2, bool dumpIR = false);
 	void semantic();
 	void printIR(std::ostream &os = std::cerr);
 
+	std::shared_ptr<IR> getIR() { return ir; }
+
 private:
 	void semanticCheck();
 	void getCode();
@@ -34,6 +47,7 @@ private:
 	/*Input file*/
 	std::ifstream src;
 	std::string fileName;
+	OptLevel optLevel;
 
 	/*IR constructors*/
 	std::shared_ptr<Lexer> lexer;
@@ -6,30 +6,24 @@
 
 class BasicBlock;
 class Register;
-class MoveAssembly;
 class StackLocation;
 class PhysicalRegister;
+class RISCVinstruction;
 /*
 This struct is for register allocation information
 */
 struct RAinfo {
-	// This might causes memory leak, remember to destruct these set
-	std::set<std::shared_ptr<Register> > adjList;
-	std::set<std::shared_ptr<MoveAssembly> > moveList;
-	int degree;
-	std::shared_ptr<Register> alias;
+	int id;  // dense index of the node in the current allocation round
 	std::shared_ptr<PhysicalRegister> color;
 	std::shared_ptr<StackLocation> spilladdr;
+	std::shared_ptr<RISCVinstruction> remat;  // the li/la to repeat at every use instead of a stack slot
 
 	RAinfo() { clear(); }
 	void clear() {
+		id = -1;
 		color = nullptr;
-		degree = 0;
-
-		adjList.clear();
-		moveList.clear();
-		alias = nullptr;
 		spilladdr = nullptr;
+		remat = nullptr;
 	}
 };
 
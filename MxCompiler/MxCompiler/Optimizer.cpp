@@ -7,18 +7,30 @@ void Optimizer::optimize()
 
 	std::make_shared<SSAConstructor>(ir)->run();
 
-	std::ofstream os("temp.txt");
-	std::make_shared<IR_Printer>(ir, os)->print();
-	os.close();
-	auto CEE = ConstantExpressionEvaluation(ir);
+	if (DEBUG) {
+		std::ofstream os("temp.txt");
+		std::make_shared<IR_Printer>(ir, os)->print();
+		os.close();
+	}
+	// SCCP folds constant branches and the phi-functions they feed in one go,
+	// GVN removes redundant computations, CEE then propagates the resulting
+	// immediates/copies and folds string builtins before LICM looks for invariants;
+	// strength reduction then rewrites array indexing on the induction variables.
+	// The inliner works on the optimized bodies, and the inlined code goes through the scalar passes again
 	auto cfgClearUp = CFGCleanUpPass(ir);
-	bool changed;
-	do
-	{
-		changed = false;
-		changed |= CEE.run();
-		changed |= cfgClearUp.run();
-	} while (changed);
+	SparseCondConstPropagation(ir).run();
+	GlobalValueNumbering(ir).run();
+	ConstantExpressionEvaluation(ir).run();
+	DeadCodeEliminationPass(ir).run();
+	if (FunctionInliner(ir).run()) {
+		SparseCondConstPropagation(ir).run();
+		GlobalValueNumbering(ir).run();
+		ConstantExpressionEvaluation(ir).run();
+	}
+	LoopInvariantCodeMotion(ir).run();
+	StrengthReduction(ir).run();
+	cfgClearUp.run();
+	DeadCodeEliminationPass(ir).run();
 	
 	// std::make_shared<IR_Printer>(ir, std::cerr)->print();
 	std::make_shared<SSADestructor>(ir)->run();
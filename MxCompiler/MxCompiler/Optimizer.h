@@ -4,6 +4,11 @@
 #include "SSADestructor.h"
 #include "dead_code_elimination.h"
 #include "ConstantExpressionEvaluation.h"
+#include "SCCP.h"
+#include "GlobalValueNumbering.h"
+#include "functionInliner.h"
+#include "LICM.h"
+#include "StrengthReduction.h"
 #include "CFGCleanUp.h"
 
 /*
@@ -16,6 +16,7 @@ class Address : public Operand {
 public:
 	Address(int o) : offset(o) {}
 	int getOffset() { return offset; }
+	void setOffset(int o) { offset = o; }
 	virtual void accept(CFG_Visitor &vis) {/*do nothing*/}
 
 protected:
@@ -43,6 +44,7 @@ public:
 	Category category() override { return STACK; }
 
 	bool isTopDown() { return topdown; }
+	void setTopDown(bool _topdown) { topdown = _topdown; }
 
 	std::shared_ptr<PhysicalRegister> getSp() { return sp; }
 	std::shared_ptr<RISCVFunction> getFunction() { return f.lock(); }
@@ -63,7 +63,6 @@ void RISCVProgram::resetPrecoloredRegs()
 {
 	for (auto it : physicalRegs) {
 		it.second->info().clear();
-		it.second->info().degree = 2333;
 		it.second->info().color = it.second;
 	}
 }
@@ -127,3 +126,114 @@ void RISCVFunction::DFS(std::shared_ptr<RISCVBasicBlock> b, std::set<std::shared
 	visited.insert(b);
 	for (auto bb : b->getToBlocks()) DFS(bb, visited);
 }
+
+// reverse postorder from <root> along the edges (reversed with <post>), then dominators by
+// the iterative algorithm of Cooper, Harvey and Kennedy; idom[0] = 0 is the root
+static void dominatorTree(std::shared_ptr<RISCVBasicBlock> root, bool post,
+	std::vector<std::shared_ptr<RISCVBasicBlock> > &order, std::map<RISCVBasicBlock *, int> &index, std::vector<int> &idom)
+{
+	auto succ = [post](const std::shared_ptr<RISCVBasicBlock> &b) -> std::set<std::shared_ptr<RISCVBasicBlock> > & {
+		return post ? b->getFromBlocks() : b->getToBlocks();
+	};
+	auto pred = [post](const std::shared_ptr<RISCVBasicBlock> &b) -> std::set<std::shared_ptr<RISCVBasicBlock> > & {
+		return post ? b->getToBlocks() : b->getFromBlocks();
+	};
+
+	order.clear();
+	index.clear();
+	std::vector<std::pair<std::shared_ptr<RISCVBasicBlock>, bool> > stack{ { root, false } };
+	std::set<RISCVBasicBlock *> visited;
+	while (!stack.empty()) {
+		auto top = stack.back();
+		stack.pop_back();
+		if (top.second) {
+			order.push_back(top.first);
+			continue;
+		}
+		if (!visited.insert(top.first.get()).second) continue;
+		stack.push_back({ top.first, true });
+		for (auto &bb : succ(top.first))
+			if (visited.find(bb.get()) == visited.end()) stack.push_back({ bb, false });
+	}
+	std::reverse(order.begin(), order.end());
+	int n = order.size();
+	for (int k = 0; k < n; k++) index[order[k].get()] = k;
+
+	idom.assign(n, -1);
+	idom[0] = 0;
+	auto intersect = [&](int x, int y) {
+		while (x != y) {
+			while (x > y) x = idom[x];
+			while (y > x) y = idom[y];
+		}
+		return x;
+	};
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int k = 1; k < n; k++) {
+			int newIdom = -1;
+			for (auto &bb : pred(order[k])) {
+				auto it = index.find(bb.get());
+				if (it == index.end() || idom[it->second] < 0) continue;
+				newIdom = newIdom < 0 ? it->second : intersect(it->second, newIdom);
+			}
+			if (newIdom != idom[k]) {
+				idom[k] = newIdom;
+				changed = true;
+			}
+		}
+	}
+}
+
+std::map<RISCVBasicBlock *, RISCVBasicBlock *> RISCVFunction::computeDominators(bool post)
+{
+	std::vector<std::shared_ptr<RISCVBasicBlock> > order;
+	std::map<RISCVBasicBlock *, int> index;
+	std::vector<int> idom;
+	dominatorTree(post ? exit : entry, post, order, index, idom);
+
+	std::map<RISCVBasicBlock *, RISCVBasicBlock *> ret;
+	for (size_t k = 0; k < order.size(); k++) ret[order[k].get()] = order[idom[k]].get();
+	return ret;
+}
+
+void RISCVFunction::computeLoopDepth()
+{
+	std::vector<std::shared_ptr<RISCVBasicBlock> > order;
+	std::map<RISCVBasicBlock *, int> index;
+	std::vector<int> idom;
+	dominatorTree(entry, false, order, index, idom);
+	int n = order.size();
+
+	auto dominates = [&](int x, int y) {
+		while (y != x && y != 0) y = idom[y];
+		return y == x;
+	};
+
+	// the body of the loop at header h: h plus everything reaching a latch without passing h
+	std::map<int, std::set<int> > loops;
+	for (int u = 0; u < n; u++)
+		for (auto &bb : order[u]->getToBlocks()) {
+			int h = index[bb.get()];
+			if (!dominates(h, u)) continue;
+			auto &body = loops[h];
+			body.insert(h);
+			std::vector<int> worklist{ u };
+			while (!worklist.empty()) {
+				int x = worklist.back();
+				worklist.pop_back();
+				if (!body.insert(x).second) continue;
+				for (auto &pred : order[x]->getFromBlocks()) {
+					auto it = index.find(pred.get());
+					if (it != index.end()) worklist.push_back(it->second);
+				}
+			}
+		}
+
+	for (auto &b : blocks) b->setLoopDepth(0);
+	std::vector<int> depth(n, 0);
+	for (auto &loop : loops)
+		for (auto x : loop.second) depth[x]++;
+	for (int k = 0; k < n; k++) order[k]->setLoopDepth(depth[k]);
+}
@@ -16,7 +16,7 @@ public:
 class RISCVBasicBlock :public std::enable_shared_from_this<RISCVBasicBlock> {
 public:
 	RISCVBasicBlock(std::weak_ptr<RISCVFunction> _f, std::string _label) 
-		: label(_label), func(_f) {}
+		: label(_label), func(_f), loopDepth(0) {}
 
 	void append(const std::shared_ptr<RISCVinstruction> &i);
 
@@ -36,8 +36,13 @@ public:
 	void insertToBlock(std::shared_ptr<RISCVBasicBlock> b) { to.insert(b); }
 	void insertFromBlock(std::shared_ptr<RISCVBasicBlock> b) { from.insert(b); }
 
+	// number of natural loops containing the block, c.f. RISCVFunction::computeLoopDepth
+	int getLoopDepth() { return loopDepth; }
+	void setLoopDepth(int depth) { loopDepth = depth; }
+
 private:
 	std::string label;
+	int loopDepth;
 	std::shared_ptr<RISCVinstruction> front;
 	std::weak_ptr<RISCVinstruction> back;
 	std::weak_ptr<RISCVFunction> func;
@@ -63,6 +68,12 @@ public:
 
 	int stackLocationFromBottom(int size);
 	void setLowerBoundForStackSizeFromTop(int x) { stackSizeFromTop = std::max(stackSizeFromTop, x); }
+	int getStackSizeFromTop() { return stackSizeFromTop; }
+	void setStackSizeFromBottom(int x) { stackSizeFromBottom = x; }
+
+	// the slots handed out to spilled registers, laid out again by <StackSlotAllocator>
+	void addSpillSlot(std::shared_ptr<StackLocation> slot) { spillSlots.push_back(slot); }
+	std::vector<std::shared_ptr<StackLocation> > &getSpillSlots() { return spillSlots; }
 
 	int getStackSize() {
 		return (stackSizeFromBottom + stackSizeFromTop + 15) / 16 * 16;
@@ -71,6 +82,13 @@ public:
 	void computePreOrderList();
 	void DFS(std::shared_ptr<RISCVBasicBlock> b, 
 		std::set<std::shared_ptr<RISCVBasicBlock> > &visited);
+
+	// sets the loop depth of every block, from the back edges on the dominator tree
+	// (loops sharing a header count once)
+	void computeLoopDepth();
+	// the immediate dominator (post-dominator with <post>) of every block reachable from the
+	// entry (reaching the exit); the root is its own
+	std::map<RISCVBasicBlock *, RISCVBasicBlock *> computeDominators(bool post = false);
 private:
 	std::string name;
 	std::vector<std::shared_ptr<RISCVBasicBlock> > blocks;
@@ -78,6 +96,7 @@ private:
 	std::shared_ptr<RISCVBasicBlock> entry, exit;
 
 	int stackSizeFromBottom, stackSizeFromTop;
+	std::vector<std::shared_ptr<StackLocation> > spillSlots;
 };
 
 
@@ -7,13 +7,18 @@ void RISCVCodeGenerator::generate()
 	riscv_program = instructionSelector.getRISCVProgram();
 	std::cout << "assembly code generation is completed.\n";
 
-	auto regalloc = RegisterAllocator(riscv_program);
-	regalloc.run();
+	if (schedule) InstructionScheduler(riscv_program, InstructionScheduler::REGISTER_PRESSURE).run();
+	if (fastRegAlloc) LinearScanAllocator(riscv_program).run();
+	else RegisterAllocator(riscv_program).run();
 
 	auto peeholeOpt = PeeholeMatchingOptimizer(riscv_program);
 	peeholeOpt.run();
 
-	setSP();
+	auto frameLowering = FrameLowering(riscv_program);
+	frameLowering.removeUnusedSaves();
+	StackSlotAllocator(riscv_program).run();
+	frameLowering.run();
+	if (schedule) InstructionScheduler(riscv_program, InstructionScheduler::LATENCY).run();
 	renameMainFunction();
 	std::cout << "register allocation is completed\n";
 }
@@ -42,20 +47,6 @@ void RISCVCodeGenerator::emit()
 	for (auto f : riscv_program->getFunctions()) emitFunction(f);
 }
 
-void RISCVCodeGenerator::setSP()
-{
-	for (auto &f : riscv_program->getFunctions()) {
-		int stackSize = f->getStackSize();
-		if (stackSize > 0) {
-			auto sp = (*riscv_program)["sp"];
-			appendBefore(f->getEntry()->getFront(), std::make_shared<I_type>(
-				f->getEntry(), I_type::ADDI, sp, sp, std::make_shared<Immediate>(-stackSize)));
-			appendBefore(f->getExit()->getBack(), std::make_shared<I_type>(
-				f->getExit(), I_type::ADDI, sp, sp, std::make_shared<Immediate>(stackSize)));
-		}
-	}
-}
-
 void RISCVCodeGenerator::renameMainFunction()
 {
 	for (auto &f : riscv_program->getFunctions())
@@ -5,14 +5,20 @@
 #include "instructionSelector.h"
 #include "RISCVassembly.h"
 #include "registerAllocator.h"
+#include "linearScanAllocator.h"
+#include "stackSlotAllocator.h"
+#include "frameLowering.h"
+#include "instructionScheduler.h"
 
 /*
 This class is an interface class for the toplevel MxCompiler class.
 */
 class RISCVCodeGenerator : public CFG_Visitor {
 public:
-	RISCVCodeGenerator(std::shared_ptr<IR> _ir, std::ostream &_os = std::cerr) 
-		:os(_os), ir(_ir){}
+	// <fastRegAlloc>: use the linear scan allocator instead of graph coloring
+	// <schedule>: schedule the instructions before and after register allocation
+	RISCVCodeGenerator(std::shared_ptr<IR> _ir, std::ostream &_os = std::cerr, bool _fastRegAlloc = false, bool _schedule = false)
+		:os(_os), ir(_ir), fastRegAlloc(_fastRegAlloc), schedule(_schedule) {}
 
 	void generate();
 	void emit();
@@ -20,11 +26,11 @@ private:
 	std::shared_ptr<IR> ir;
 	std::shared_ptr<RISCVProgram> riscv_program;
 	std::ostream &os;
+	bool fastRegAlloc, schedule;
 
 	std::map<std::shared_ptr<RISCVBasicBlock>, std::string> label;
 	std::map<std::shared_ptr<Register>, int> stringLabel;
 	
-	void setSP();
 	void renameMainFunction();
 
 	void emitFunction(std::shared_ptr<RISCVFunction> f);
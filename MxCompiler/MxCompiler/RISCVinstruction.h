@@ -123,6 +123,7 @@ public:
 		:RISCVinstruction(b, RTYPE), op(_op), rd(_rd), rs1(_rs1), rs2(_rs2) {}
 
 	std::shared_ptr<Register> getRd() { return rd; }
+	Operator getOp() { return op; }
 	
 	std::shared_ptr<Register>getRS1() { return rs1; }
 	std::shared_ptr<Register> getRs2() { return rs2; }
@@ -233,6 +234,7 @@ public:
 
 	std::shared_ptr<Register> getRd() { return rd; }
 	std::shared_ptr<Address> getAddr() { return addr; }
+	int getSize() { return size; }
 
 	std::string toString() override;
 	std::vector<std::shared_ptr<Register> > getUseReg() override;  
@@ -0,0 +1,257 @@
+#include "SCCP.h"
+
+bool SparseCondConstPropagation::run()
+{
+	changed = false;
+	for (auto &f : ir->getFunctions()) {
+		propagate(f);
+		rewrite(f);
+	}
+	return changed;
+}
+
+void SparseCondConstPropagation::propagate(std::shared_ptr<Function> f)
+{
+	resolveDefineUseChain(f);
+	value.clear();
+	multiDef.clear();
+	executableBlocks.clear();
+	executableEdges.clear();
+
+	std::set<std::shared_ptr<Register> > defined;
+	for (auto &b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			auto reg = i->getDefReg();
+			if (reg != nullptr && !defined.insert(reg).second) multiDef.insert(reg);
+		}
+
+	cfgWorkList.push(std::make_pair(nullptr, f->getEntry()));
+	while (!cfgWorkList.empty() || !ssaWorkList.empty()) {
+		while (!cfgWorkList.empty()) {
+			auto e = cfgWorkList.front();
+			cfgWorkList.pop();
+			visitEdge(e.first, e.second);
+		}
+		while (!ssaWorkList.empty()) {
+			auto i = ssaWorkList.front();
+			ssaWorkList.pop();
+			if (executableBlocks.find(i->getBlock().get()) == executableBlocks.end()) continue;
+			if (i->getTag() == IRInstruction::PHI) visitPhi(std::static_pointer_cast<PhiFunction>(i));
+			else visitInstruction(i);
+		}
+	}
+}
+
+void SparseCondConstPropagation::visitEdge(std::shared_ptr<BasicBlock> from, std::shared_ptr<BasicBlock> to)
+{
+	if (from != nullptr && !executableEdges.insert(std::make_pair(from.get(), to.get())).second) return;
+
+	bool firstVisit = executableBlocks.insert(to.get()).second;
+	for (auto i = to->getFront(); i != nullptr; i = i->getNextInstr())
+		if (i->getTag() == IRInstruction::PHI) visitPhi(std::static_pointer_cast<PhiFunction>(i));
+		else if (firstVisit) visitInstruction(i);
+		else break;
+}
+
+void SparseCondConstPropagation::visitPhi(std::shared_ptr<PhiFunction> phi)
+{
+	LatticeValue result;
+	auto b = phi->getBlock();
+	for (auto &option : phi->getRelatedRegs()) {
+		if (!isExecutable(option.second.lock(), b)) continue;
+		// an undefined option may hold anything, keep it conservative
+		auto v = option.first == nullptr ? bottom() : getValue(option.first);
+		if (v.state == LatticeValue::TOP) continue;
+		if (result.state == LatticeValue::TOP) result = v;
+		else if (result != v) result = bottom();
+	}
+	update(phi->getDst(), result);
+}
+
+void SparseCondConstPropagation::visitInstruction(std::shared_ptr<IRInstruction> i)
+{
+	auto b = i->getBlock();
+	switch (i->getTag())
+	{
+	case IRInstruction::QUADR:
+		if (i->getDefReg() != nullptr)
+			update(i->getDefReg(), evaluate(std::static_pointer_cast<Quadruple>(i)));
+		break;
+	case IRInstruction::BRANCH: {
+		auto br = std::static_pointer_cast<Branch>(i);
+		auto cond = getValue(br->getCondition());
+		if (cond.state == LatticeValue::CONST)
+			markEdge(b, cond.value ? br->getTrueBlock() : br->getFalseBlock());
+		else if (cond.state == LatticeValue::BOTTOM) {
+			markEdge(b, br->getTrueBlock());
+			markEdge(b, br->getFalseBlock());
+		}
+		break;
+	}
+	case IRInstruction::JUMP:
+		markEdge(b, std::static_pointer_cast<Jump>(i)->getTarget());
+		break;
+	default:
+		if (i->getDefReg() != nullptr) update(i->getDefReg(), bottom());
+		if (i == b->getBack())
+			for (auto &to : b->getBlocksTo()) markEdge(b, to);
+		break;
+	}
+}
+
+void SparseCondConstPropagation::markEdge(std::shared_ptr<BasicBlock> from, std::shared_ptr<BasicBlock> to)
+{
+	if (!isExecutable(from, to)) cfgWorkList.push(std::make_pair(from, to));
+}
+
+void SparseCondConstPropagation::update(std::shared_ptr<Register> reg, LatticeValue v)
+{
+	if (multiDef.find(reg) != multiDef.end()) return;
+	auto &old = value[reg];
+	// values may only move down the lattice
+	if (old.state == LatticeValue::BOTTOM || v.state == LatticeValue::TOP) return;
+	if (old.state == LatticeValue::CONST && old != v) v = bottom();
+	if (!(old != v)) return;
+	old = v;
+	for (auto &user : use[reg]) ssaWorkList.push(user);
+}
+
+SparseCondConstPropagation::LatticeValue SparseCondConstPropagation::getValue(std::shared_ptr<Operand> op)
+{
+	if (op->category() == Operand::IMM)
+		return constant(std::static_pointer_cast<Immediate>(op)->getValue());
+	if (!Operand::isRegister(op->category())) return bottom();
+
+	auto reg = std::static_pointer_cast<Register>(op);
+	// arguments, globals and static strings are not defined inside the function
+	if (def.find(reg) == def.end() || multiDef.find(reg) != multiDef.end()) return bottom();
+	auto it = value.find(reg);
+	return it == value.end() ? LatticeValue() : it->second;
+}
+
+SparseCondConstPropagation::LatticeValue SparseCondConstPropagation::evaluate(std::shared_ptr<Quadruple> q)
+{
+	auto op = q->getOp();
+	if (op == Quadruple::LOAD) return bottom();
+
+	auto a = getValue(q->getSrc1());
+	if (op == Quadruple::MOVE) return a;
+	if (op == Quadruple::NEG || op == Quadruple::INV) {
+		if (a.state != LatticeValue::CONST) return a;
+		return constant(op == Quadruple::NEG ? (int)(0u - (unsigned)a.value) : ~a.value);
+	}
+
+	auto b = getValue(q->getSrc2());
+	if (op == Quadruple::TIMES || op == Quadruple::BITAND) {  // x * 0 = x & 0 = 0
+		if ((a.state == LatticeValue::CONST && a.value == 0) || (b.state == LatticeValue::CONST && b.value == 0))
+			return constant(0);
+	}
+	if (a.state == LatticeValue::BOTTOM || b.state == LatticeValue::BOTTOM) return bottom();
+	if (a.state == LatticeValue::TOP || b.state == LatticeValue::TOP) return LatticeValue();
+
+	// wrap around like RV32 instead of relying on signed overflow
+	int x = a.value, y = b.value;
+	unsigned ux = x, uy = y;
+	switch (op)
+	{
+	case Quadruple::ADD: return constant((int)(ux + uy));
+	case Quadruple::MINUS: return constant((int)(ux - uy));
+	case Quadruple::TIMES: return constant((int)(ux * uy));
+	case Quadruple::DIVIDE:
+		if (y == 0 || (y == -1 && x == (int)0x80000000u)) return bottom();
+		return constant(x / y);
+	case Quadruple::MOD:
+		if (y == 0 || (y == -1 && x == (int)0x80000000u)) return bottom();
+		return constant(x % y);
+	case Quadruple::LSHIFT:
+		if (y < 0 || y > 31) return bottom();
+		return constant((int)(ux << y));
+	case Quadruple::RSHIFT:
+		if (y < 0 || y > 31) return bottom();
+		return constant(x >> y);
+	case Quadruple::BITAND: return constant(x & y);
+	case Quadruple::BITOR: return constant(x | y);
+	case Quadruple::BITXOR: return constant(x ^ y);
+	case Quadruple::LESS: return constant(x < y);
+	case Quadruple::LEQ: return constant(x <= y);
+	case Quadruple::GREATER: return constant(x > y);
+	case Quadruple::GEQ: return constant(x >= y);
+	case Quadruple::EQ: return constant(x == y);
+	case Quadruple::NEQ: return constant(x != y);
+	default:
+		return bottom();
+	}
+}
+
+bool SparseCondConstPropagation::isExecutable(std::shared_ptr<BasicBlock> from, std::shared_ptr<BasicBlock> to)
+{
+	return from != nullptr && executableEdges.find(std::make_pair(from.get(), to.get())) != executableEdges.end();
+}
+
+void SparseCondConstPropagation::rewrite(std::shared_ptr<Function> f)
+{
+	bool cfgChanged = false;
+	auto blocks = f->getBlockList();
+	for (auto &b : blocks) {
+		if (executableBlocks.find(b.get()) == executableBlocks.end()) continue;
+
+		std::vector<std::shared_ptr<PhiFunction> > constPhis;
+		auto i = b->getFront();
+		for (; i->getTag() == IRInstruction::PHI; i = i->getNextInstr()) {
+			auto phi = std::static_pointer_cast<PhiFunction>(i);
+			if (getValue(phi->getDst()).state == LatticeValue::CONST) constPhis.push_back(phi);
+		}
+		// phi-functions must stay at the front, so the moves go after the last one
+		for (auto &phi : constPhis) {
+			changed = true;
+			appendInstrBefore(i, std::make_shared<Quadruple>(b, Quadruple::MOVE, phi->getDst(),
+				std::make_shared<Immediate>(getValue(phi->getDst()).value)));
+			removeInstruction(phi);
+		}
+
+		for (; i != nullptr; i = i->getNextInstr()) {
+			if (i->getTag() == IRInstruction::QUADR && i->getDefReg() != nullptr) {
+				auto q = std::static_pointer_cast<Quadruple>(i);
+				auto v = getValue(q->getDst());
+				if (v.state != LatticeValue::CONST) continue;
+				if (q->getOp() == Quadruple::MOVE && q->getSrc1()->category() == Operand::IMM) continue;
+				changed = true;
+				auto move = std::make_shared<Quadruple>(b, Quadruple::MOVE, q->getDst(), std::make_shared<Immediate>(v.value));
+				replaceInstruction(i, move);
+				i = move;
+			}
+			else if (i->getTag() == IRInstruction::BRANCH) {
+				auto br = std::static_pointer_cast<Branch>(i);
+				auto cond = getValue(br->getCondition());
+				if (cond.state != LatticeValue::CONST || br->getTrueBlock() == br->getFalseBlock()) continue;
+				changed = true;
+				auto jump = std::make_shared<Jump>(b, cond.value ? br->getTrueBlock() : br->getFalseBlock());
+				replaceInstruction(i, jump);
+				i = jump;
+			}
+		}
+	}
+
+	// drop every edge that was never proven executable (including the untaken side of folded branches)
+	for (auto &b : blocks) {
+		if (executableBlocks.find(b.get()) == executableBlocks.end()) continue;
+		auto preds = b->getBlocksFrom(), succs = b->getBlocksTo();
+		for (auto &p : preds)
+			if (!isExecutable(p, b)) cfgChanged |= removeEdge(p, b);
+		for (auto &s : succs)
+			if (!isExecutable(b, s)) cfgChanged |= removeEdge(b, s);
+	}
+	if (cfgChanged) {
+		changed = true;
+		updateDTinfo(f);
+	}
+}
+
+bool SparseCondConstPropagation::removeEdge(std::shared_ptr<BasicBlock> from, std::shared_ptr<BasicBlock> to)
+{
+	for (auto i = to->getFront(); i->getTag() == IRInstruction::PHI; i = i->getNextInstr())
+		std::static_pointer_cast<PhiFunction>(i)->removeOption(from);
+	from->getBlocksTo().erase(to);
+	to->getBlocksFrom().erase(from);
+	return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "cfg_pass.h"
+#include "IRinstruction.h"
+#include "IR.h"
+#include<queue>
+
+/*
+Sparse conditional constant propagation (Wegman & Zadeck) on SSA form.
+Every register holds a lattice value TOP / CONST / BOTTOM, and only the
+CFG edges proven executable contribute to a <PhiFunction>. Constant
+definitions are rewritten into MOVEs of immediates (propagated later by
+<ConstantExpressionEvaluation>), branches on constants become jumps and
+edges from unreachable blocks are dropped together with their phi options.
+*/
+class SparseCondConstPropagation :public CFG_Pass {
+public:
+	SparseCondConstPropagation(std::shared_ptr<IR> _ir) :CFG_Pass(_ir) {}
+
+	bool run() override;
+
+private:
+	struct LatticeValue
+	{
+		enum State
+		{
+			TOP, CONST, BOTTOM
+		} state = TOP;
+		int value = 0;
+
+		bool operator!=(const LatticeValue &rhs) const {
+			return state != rhs.state || (state == CONST && value != rhs.value);
+		}
+	};
+	static LatticeValue constant(int v) { return { LatticeValue::CONST, v }; }
+	static LatticeValue bottom() { return { LatticeValue::BOTTOM, 0 }; }
+
+	bool changed;
+
+	std::map<std::shared_ptr<Register>, LatticeValue> value;
+	std::set<std::shared_ptr<Register> > multiDef;  // not in SSA form (e.g. globals)
+	std::set<BasicBlock *> executableBlocks;
+	std::set<std::pair<BasicBlock *, BasicBlock *> > executableEdges;
+
+	std::queue<std::pair<std::shared_ptr<BasicBlock>, std::shared_ptr<BasicBlock> > > cfgWorkList;
+	std::queue<std::shared_ptr<IRInstruction> > ssaWorkList;
+
+	void propagate(std::shared_ptr<Function> f);
+	void rewrite(std::shared_ptr<Function> f);
+
+	void visitEdge(std::shared_ptr<BasicBlock> from, std::shared_ptr<BasicBlock> to);
+	void visitPhi(std::shared_ptr<PhiFunction> phi);
+	void visitInstruction(std::shared_ptr<IRInstruction> i);
+	void markEdge(std::shared_ptr<BasicBlock> from, std::shared_ptr<BasicBlock> to);
+	void update(std::shared_ptr<Register> reg, LatticeValue v);
+
+	LatticeValue getValue(std::shared_ptr<Operand> op);
+	LatticeValue evaluate(std::shared_ptr<Quadruple> q);
+	bool isExecutable(std::shared_ptr<BasicBlock> from, std::shared_ptr<BasicBlock> to);
+	bool removeEdge(std::shared_ptr<BasicBlock> from, std::shared_ptr<BasicBlock> to);
+};
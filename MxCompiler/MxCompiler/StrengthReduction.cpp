@@ -0,0 +1,235 @@
+#include "StrengthReduction.h"
+
+bool StrengthReduction::run()
+{
+	changed = false;
+	for (auto &f : ir->getFunctions()) {
+		if (f->getLoopNest() == nullptr) {
+			updateDTinfo(f);
+			f->setLoopNest(std::make_shared<LoopNest>(f));
+		}
+		for (auto &l : f->getLoopNest()->getLoopsInnermostFirst()) {
+			resolveDefineUseChain(f);
+			reduce(f, l);
+		}
+	}
+	return changed;
+}
+
+void StrengthReduction::reduce(std::shared_ptr<Function> f, std::shared_ptr<NaturalLoop> l)
+{
+	if (l->getPreheader() == nullptr || l->getLatches().size() != 1) return;
+	std::vector<std::shared_ptr<Register> > order;
+	findInductionVariables(f, l);
+	for (auto &b : f->getBlockList())
+		if (l->contains(b))
+			for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr())
+				if (i->getDefReg() != nullptr && derived.find(i->getDefReg()) != derived.end())
+					order.push_back(i->getDefReg());
+
+	std::map<std::shared_ptr<Register>, std::pair<std::shared_ptr<Register>, DerivedIV> > addressLike;
+	for (auto &reg : order) {
+		auto &d = derived[reg];
+		bool needed = false, replaceable = true;
+		for (auto &user : use[reg]) {
+			if (user->getTag() == IRInstruction::PHI) replaceable = false;
+			auto dst = user->getDefReg();
+			if (dst == nullptr || derived.find(dst) == derived.end() || derived[dst].instr != user) needed = true;
+		}
+		if (!needed || !replaceable) continue;
+
+		auto reduced = createReducedIV(l, d);
+		replaceUses(reg, reduced);
+		if (d.scale > 0 && d.addend != nullptr && Operand::isRegister(d.addend->category())
+			&& addressLike.find(d.iv) == addressLike.end())
+			addressLike[d.iv] = std::make_pair(reduced, d);
+	}
+
+	for (auto &it : addressLike) replaceExitTest(l, it.first, it.second.second, it.second.first);
+}
+
+void StrengthReduction::findInductionVariables(std::shared_ptr<Function> f, std::shared_ptr<NaturalLoop> l)
+{
+	basic.clear();
+	derived.clear();
+	auto preheader = l->getPreheader(), latch = l->getLatches()[0];
+
+	for (auto i = l->getHeader()->getFront(); i->getTag() == IRInstruction::PHI; i = i->getNextInstr()) {
+		auto phi = std::static_pointer_cast<PhiFunction>(i);
+		if (phi->getRelatedRegs().size() != 2) continue;
+		std::shared_ptr<Register> init = nullptr, next = nullptr;
+		for (auto &option : phi->getRelatedRegs()) {
+			if (option.second.lock() == preheader) init = option.first;
+			else if (option.second.lock() == latch) next = option.first;
+		}
+		if (init == nullptr || next == nullptr || def.find(next) == def.end()) continue;
+
+		auto inc = def[next];
+		if (inc->getTag() != IRInstruction::QUADR || !l->contains(inc->getBlock())) continue;
+		auto q = std::static_pointer_cast<Quadruple>(inc);
+		auto src1 = q->getSrc1(), src2 = q->getSrc2();
+		if (q->getOp() == Quadruple::ADD && src1->category() == Operand::IMM) std::swap(src1, src2);
+		if (src1 != phi->getDst() || src2 == nullptr || src2->category() != Operand::IMM) continue;
+
+		int c = std::static_pointer_cast<Immediate>(src2)->getValue();
+		if (q->getOp() == Quadruple::ADD) basic[phi->getDst()] = { init, inc, c };
+		else if (q->getOp() == Quadruple::MINUS) basic[phi->getDst()] = { init, inc, -c };
+	}
+
+	for (auto &b : f->getBlockList()) {
+		if (!l->contains(b)) continue;
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			if (i->getTag() != IRInstruction::QUADR || i->getDefReg() == nullptr) continue;
+			auto q = std::static_pointer_cast<Quadruple>(i);
+			auto src1 = q->getSrc1(), src2 = q->getSrc2();
+			auto isBasic = [&](std::shared_ptr<Operand> x) {
+				return x != nullptr && Operand::isRegister(x->category())
+					&& basic.find(std::static_pointer_cast<Register>(x)) != basic.end();
+			};
+			auto isScaled = [&](std::shared_ptr<Operand> x) {
+				if (x == nullptr || !Operand::isRegister(x->category())) return false;
+				auto it = derived.find(std::static_pointer_cast<Register>(x));
+				return it != derived.end() && it->second.addend == nullptr;
+			};
+
+			switch (q->getOp())
+			{
+			case Quadruple::LSHIFT:
+				if (isBasic(src1) && src2->category() == Operand::IMM) {
+					int k = std::static_pointer_cast<Immediate>(src2)->getValue();
+					if (k >= 0 && k <= 30)
+						derived[q->getDefReg()] = { std::static_pointer_cast<Register>(src1), 1 << k, nullptr, i };
+				}
+				break;
+			case Quadruple::TIMES:
+				if (src1->category() == Operand::IMM) std::swap(src1, src2);
+				if (isBasic(src1) && src2->category() == Operand::IMM)
+					derived[q->getDefReg()] = { std::static_pointer_cast<Register>(src1),
+						std::static_pointer_cast<Immediate>(src2)->getValue(), nullptr, i };
+				break;
+			case Quadruple::ADD:
+				if (!isScaled(src1)) std::swap(src1, src2);
+				if (isScaled(src1) && isInvariant(src2, l)) {
+					auto &base = derived[std::static_pointer_cast<Register>(src1)];
+					derived[q->getDefReg()] = { base.iv, base.scale, src2, i };
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+std::shared_ptr<Register> StrengthReduction::createReducedIV(std::shared_ptr<NaturalLoop> l, const DerivedIV &d)
+{
+	changed = true;
+	auto header = l->getHeader(), latch = l->getLatches()[0];
+	auto &b = basic[d.iv];
+
+	std::shared_ptr<Operand> start = b.init;
+	auto it = def.find(b.init);
+	if (it != def.end() && it->second->getTag() == IRInstruction::QUADR) {  // usually i = 0
+		auto q = std::static_pointer_cast<Quadruple>(it->second);
+		if (q->getOp() == Quadruple::MOVE && q->getSrc1()->category() == Operand::IMM) start = q->getSrc1();
+	}
+	auto init = emitAffine(l->getPreheader(), start, d.scale, d.addend);
+	auto reduced = std::make_shared<VirtualReg>(), next = std::make_shared<VirtualReg>();
+	auto phi = std::make_shared<PhiFunction>(header, reduced);
+	auto inc = std::make_shared<Quadruple>(latch, Quadruple::ADD, next, reduced,
+		std::make_shared<Immediate>((int)((unsigned)d.scale * (unsigned)b.step)));
+	phi->appendRelatedReg(init, l->getPreheader());
+	phi->appendRelatedReg(next, latch);
+	header->append_front(phi);
+	appendInstrBefore(latch->getBack(), inc);
+
+	def[reduced] = phi;
+	def[next] = inc;
+	use[reduced].insert(inc);
+	use[next].insert(phi);
+	return reduced;
+}
+
+void StrengthReduction::replaceExitTest(std::shared_ptr<NaturalLoop> l, std::shared_ptr<Register> iv,
+	const DerivedIV &d, std::shared_ptr<Register> reduced)
+{
+	auto &b = basic[iv];
+	auto next = b.increment->getDefReg();
+	if (use[next].size() != 1 || *use[next].begin() != def[iv]) return;  // live after the loop
+
+	std::vector<std::shared_ptr<Quadruple> > tests;
+	for (auto &user : use[iv]) {
+		if (user == b.increment) continue;
+		std::set<std::shared_ptr<Register> > visiting;
+		if (user->getDefReg() != nullptr && user->getTag() == IRInstruction::QUADR && isDead(user->getDefReg(), visiting))
+			continue;
+
+		if (user->getTag() != IRInstruction::QUADR || !l->contains(user->getBlock())) return;
+		auto q = std::static_pointer_cast<Quadruple>(user);
+		auto op = q->getOp();
+		if (op != Quadruple::LESS && op != Quadruple::LEQ && op != Quadruple::GREATER &&
+			op != Quadruple::GEQ && op != Quadruple::EQ && op != Quadruple::NEQ) return;
+		auto bound = q->getSrc1() == iv ? q->getSrc2() : q->getSrc1();
+		if (bound == iv || !isInvariant(bound, l)) return;
+		tests.push_back(q);
+	}
+
+	for (auto &q : tests) {
+		auto bound = q->getSrc1() == iv ? q->getSrc2() : q->getSrc1();
+		auto newBound = emitAffine(l->getPreheader(), bound, d.scale, d.addend);
+		q->replaceUseReg(bound, newBound);
+		q->replaceUseReg(iv, reduced);
+		use[reduced].insert(q);
+	}
+}
+
+std::shared_ptr<Register> StrengthReduction::emitAffine(std::shared_ptr<BasicBlock> b, std::shared_ptr<Operand> x,
+	int scale, std::shared_ptr<Operand> addend)
+{
+	auto result = std::make_shared<VirtualReg>();
+	std::shared_ptr<Quadruple> q;
+	if (x->category() == Operand::IMM) {
+		auto value = std::make_shared<Immediate>(
+			(int)((unsigned)std::static_pointer_cast<Immediate>(x)->getValue() * (unsigned)scale));
+		if (addend == nullptr) q = std::make_shared<Quadruple>(b, Quadruple::MOVE, result, value);
+		else if (value->getValue() == 0) q = std::make_shared<Quadruple>(b, Quadruple::MOVE, result, addend);
+		else q = std::make_shared<Quadruple>(b, Quadruple::ADD, result, addend, value);
+		appendInstrBefore(b->getBack(), q);
+		return result;
+	}
+
+	// multiplications by powers of 2 are turned into shifts by CFGCleanUpPass
+	auto scaled = addend == nullptr ? result : std::make_shared<VirtualReg>();
+	appendInstrBefore(b->getBack(), std::make_shared<Quadruple>(b, Quadruple::TIMES, scaled, x,
+		std::make_shared<Immediate>(scale)));
+	if (addend != nullptr)
+		appendInstrBefore(b->getBack(), std::make_shared<Quadruple>(b, Quadruple::ADD, result, scaled, addend));
+	return result;
+}
+
+bool StrengthReduction::isInvariant(std::shared_ptr<Operand> op, std::shared_ptr<NaturalLoop> l)
+{
+	if (!Operand::isRegister(op->category())) return true;
+	auto it = def.find(std::static_pointer_cast<Register>(op));
+	return it == def.end() || !l->contains(it->second->getBlock());
+}
+
+// whether the value only flows into other dead values (it will be removed by ADCE)
+bool StrengthReduction::isDead(std::shared_ptr<Register> reg, std::set<std::shared_ptr<Register> > &visiting)
+{
+	if (!visiting.insert(reg).second) return true;
+	for (auto &user : use[reg]) {
+		if (user->getTag() != IRInstruction::QUADR || user->getDefReg() == nullptr) return false;
+		if (!isDead(user->getDefReg(), visiting)) return false;
+	}
+	return true;
+}
+
+void StrengthReduction::replaceUses(std::shared_ptr<Register> old, std::shared_ptr<Register> _new)
+{
+	for (auto &user : use[old]) {
+		user->replaceUseReg(old, _new);
+		use[_new].insert(user);
+	}
+	use[old].clear();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "cfg_pass.h"
+#include "loop.h"
+
+/*
+Induction variable strength reduction on SSA form (run after LICM, which
+leaves the <LoopNest> and the preheaders behind).
+A basic induction variable is a header phi-function i = phi(init, i + c)
+with a single latch. Derived ones are scale * i (SHL/TIMES by a constant)
+and scale * i + inv for a loop-invariant inv, which is what array indexing
+produces. Each derived value with users outside the derivation gets its own
+phi-function, initialized in the preheader and bumped by scale * c in the
+latch, so the multiplication leaves the loop.
+If afterwards a basic variable only feeds its own increment and comparisons
+against invariants, the comparisons are rewritten on an address-like
+(scale > 0, register addend) derived variable and the basic one is left to
+dead code elimination. That assumes addresses never wrap around.
+*/
+class StrengthReduction : public CFG_Pass {
+public:
+	StrengthReduction(std::shared_ptr<IR> ir) :CFG_Pass(ir) {}
+
+	bool run() override;
+
+private:
+	struct BasicIV
+	{
+		std::shared_ptr<Register> init;
+		std::shared_ptr<IRInstruction> increment;
+		int step;
+	};
+	struct DerivedIV
+	{
+		std::shared_ptr<Register> iv;
+		int scale;
+		std::shared_ptr<Operand> addend;  // null for scale * iv
+		std::shared_ptr<IRInstruction> instr;
+	};
+
+	bool changed;
+
+	std::map<std::shared_ptr<Register>, BasicIV> basic;
+	std::map<std::shared_ptr<Register>, DerivedIV> derived;
+
+	void reduce(std::shared_ptr<Function> f, std::shared_ptr<NaturalLoop> l);
+	void findInductionVariables(std::shared_ptr<Function> f, std::shared_ptr<NaturalLoop> l);
+	std::shared_ptr<Register> createReducedIV(std::shared_ptr<NaturalLoop> l, const DerivedIV &d);
+	void replaceExitTest(std::shared_ptr<NaturalLoop> l, std::shared_ptr<Register> iv,
+		const DerivedIV &d, std::shared_ptr<Register> reduced);
+
+	// compute scale * x + addend at the end of the preheader
+	std::shared_ptr<Register> emitAffine(std::shared_ptr<BasicBlock> b, std::shared_ptr<Operand> x,
+		int scale, std::shared_ptr<Operand> addend);
+	bool isInvariant(std::shared_ptr<Operand> op, std::shared_ptr<NaturalLoop> l);
+	bool isDead(std::shared_ptr<Register> reg, std::set<std::shared_ptr<Register> > &visiting);
+	void replaceUses(std::shared_ptr<Register> old, std::shared_ptr<Register> _new);
+};
@@ -23,6 +23,34 @@ struct DT_Info {
 	}
 };
 
+/*
+Class: BlockList
+The predecessors/successors of a basic block. A block seldom has more than
+two of them, so a vector with set-like operations is cheaper than a std::set,
+and it keeps the insertion order, which makes every traversal deterministic.
+*/
+class BlockList {
+public:
+	using iterator = std::vector<std::shared_ptr<BasicBlock> >::iterator;
+
+	iterator begin() { return blocks.begin(); }
+	iterator end() { return blocks.end(); }
+	iterator find(const std::shared_ptr<BasicBlock> &b) { return std::find(blocks.begin(), blocks.end(), b); }
+
+	size_t size() const { return blocks.size(); }
+	bool empty() const { return blocks.empty(); }
+	size_t count(const std::shared_ptr<BasicBlock> &b) { return find(b) != end(); }
+
+	void insert(const std::shared_ptr<BasicBlock> &b) { if (find(b) == end()) blocks.push_back(b); }
+	void erase(const std::shared_ptr<BasicBlock> &b) {
+		auto it = find(b);
+		if (it != end()) blocks.erase(it);
+	}
+	void clear() { blocks.clear(); }
+private:
+	std::vector<std::shared_ptr<BasicBlock> > blocks;
+};
+
 /*
 Class: BasicBlock
 */
@@ -34,7 +62,7 @@ static const std::string namesForBasicBlocks[] = {
 	"if_true", "if_false", "if_final",
 	"true", "false", "final",
 	"lhs_true", "lhs_false",
-	"parallel_copy", "shadow", "splitter"
+	"parallel_copy", "shadow", "splitter", "preheader"
 };
 
 class BasicBlock : public std::enable_shared_from_this<BasicBlock>{
@@ -47,7 +75,7 @@ public:
 		IF_TRUE, IF_FALSE, IF_FINAL,
 		TRUE, FALSE, FINAL,
 		LHS_TRUE, LHS_FALSE,
-		PARALLEL_COPY, SHADOW, SPLITTER
+		PARALLEL_COPY, SHADOW, SPLITTER, PREHEADER
 	};
 
 	BasicBlock(std::weak_ptr<Function> _func, Tag _tag)
@@ -83,8 +111,8 @@ public:
 	const DT_Info &getDTInfo() const { return dtInfo; }
 	void clearDTInfo() { dtInfo.clear(); }
 
-	std::set<std::shared_ptr<BasicBlock> > &getBlocksTo() { return to; }
-	std::set<std::shared_ptr<BasicBlock> > &getBlocksFrom() { return from; }
+	BlockList &getBlocksTo() { return to; }
+	BlockList &getBlocksFrom() { return from; }
 
 	std::string toString() { return namesForBasicBlocks[tag]; }
 
@@ -100,7 +128,7 @@ private:
 	std::shared_ptr<IRInstruction> front;
 	std::shared_ptr<IRInstruction> back;
 	
-	std::set<std::shared_ptr<BasicBlock> > from, to;
+	BlockList from, to;
 
 	bool endFlag;
 
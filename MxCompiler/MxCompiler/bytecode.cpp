@@ -0,0 +1,41 @@
+#include "bytecode.h"
+
+int BCFunction::newConstant(int v)
+{
+	auto it = constantIndex.find(v);
+	if (it != constantIndex.end()) return it->second;
+	int slot = -(int)constants.size() - 2;
+	constants.push_back(v);
+	constantIndex[v] = slot;
+	return slot;
+}
+
+void BCFunction::seal()
+{
+	for (auto &i : code) {
+		switch (i.op)
+		{
+		case BCInstruction::JMP:
+		case BCInstruction::PHI:
+		case BCInstruction::RET_VOID:
+			break;
+		case BCInstruction::BR:
+		case BCInstruction::RET:
+			i.dst = fixSlot(i.dst);
+			break;
+		case BCInstruction::CALL:
+		case BCInstruction::CALL_BUILTIN:
+			i.dst = fixSlot(i.dst);
+			break;
+		default:
+			i.dst = fixSlot(i.dst);
+			i.src1 = fixSlot(i.src1);
+			i.src2 = fixSlot(i.src2);
+			break;
+		}
+	}
+	for (auto &slot : argSlots) slot = fixSlot(slot);
+	for (auto &group : phiGroups)
+		for (auto &option : group.options)
+			for (auto &slot : option.second) slot = fixSlot(slot);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "pch.h"
+
+/*
+Pre-decoded form of the IR executed by <IR_Interpreter> in BYTECODE mode.
+Every operand is a dense slot index into the frame of the current function:
+slots [0, numLocals) hold virtual registers (arguments come first) and
+slots [numLocals, frameSize) hold the constant pool (immediates, addresses of
+global variables and static strings), which is copied into each new frame.
+Jump targets are resolved to instruction indices and call targets to
+function/builtin indices, so no string is touched during execution.
+*/
+struct BCInstruction {
+	enum Opcode
+	{
+		ADD, SUB, MUL, DIV, MOD, SHL, SHR,
+		SEQ, SNE, SLT, SLE, SGT, SGE,
+		AND, OR, XOR, INV, NEG, MOV,
+		LOAD, STORE, MALLOC,
+		CALL, CALL_BUILTIN, PHI,
+		JMP, BR, RET, RET_VOID
+	};
+	/*
+	Operands:
+		binary/unary: dst <- src1 op src2
+		store:        [dst] <- src1
+		call:         dst = result slot (-1 if none), src1 = callee, src2 = argc, aux = offset in <argSlots>
+		phi:          aux = index of the phi group of this block
+		jmp:          src1 = target pc, aux = current block
+		br:           dst = condition, src1 = true pc, src2 = false pc, aux = current block
+		ret:          dst = value
+	*/
+	BCInstruction(Opcode _op, int _dst = -1, int _src1 = -1, int _src2 = -1, int _aux = -1)
+		:op(_op), dst(_dst), src1(_src1), src2(_src2), aux(_aux) {}
+
+	Opcode op;
+	int dst, src1, src2, aux;
+};
+
+// all phi-functions at the front of a block, evaluated in parallel
+struct BCPhiGroup {
+	std::vector<int> dsts;
+	// (predecessor block, source slot of each phi in <dsts>)
+	std::vector<std::pair<int, std::vector<int> > > options;
+};
+
+class BCFunction {
+public:
+	BCFunction(const std::string &_name) :name(_name), numLocals(0), numArgs(0) {}
+
+	std::string getName() { return name; }
+
+	// constant slots are encoded as negative numbers until <seal> is called
+	int newLocal() { return numLocals++; }
+	int newConstant(int v);
+
+	// rewrite constant operands into frame slots once all locals are known
+	void seal();
+
+	int frameSize() { return numLocals + (int)constants.size(); }
+
+	std::vector<BCInstruction> code;
+	std::vector<int> argSlots;
+	std::vector<int> constants;
+	std::vector<BCPhiGroup> phiGroups;
+
+	int numLocals, numArgs;
+private:
+	std::string name;
+	std::map<int, int> constantIndex;
+
+	int fixSlot(int slot) { return slot < -1 ? numLocals + (-slot - 2) : slot; }
+};
+
+struct BCProgram {
+	std::vector<std::shared_ptr<BCFunction> > functions;
+	int entry = -1;   // index of __bootstrap
+};
@@ -2,5 +2,186 @@
 
 bool DeadCodeEliminationPass::run()
 {
-	return true;
+	changed = false;
+	for (auto &f : ir->getFunctions()) {
+		resolveDefineUseChain(f);
+		computePostDominators(f);
+		computeControlDependence(f);
+		mark(f);
+		eliminate(f);
+	}
+	return changed;
+}
+
+// Cooper, Harvey & Kennedy's iterative algorithm on the reverse CFG
+void DeadCodeEliminationPass::computePostDominators(std::shared_ptr<Function> f)
+{
+	ipdom.clear();
+	std::set<BasicBlock *> reachable;
+	for (auto &b : f->getBlockList()) reachable.insert(b.get());
+
+	std::map<BasicBlock *, int> postNum;
+	std::vector<std::shared_ptr<BasicBlock> > order;  // post order on the reverse CFG
+	std::stack<std::pair<std::shared_ptr<BasicBlock>, int> > S;
+	postNum[f->getExit().get()] = -1;
+	S.push(std::make_pair(f->getExit(), 0));
+	while (!S.empty()) {
+		auto &top = S.top();
+		auto &preds = top.first->getBlocksFrom();
+		if (top.second < (int)preds.size()) {
+			auto p = *(preds.begin() + top.second++);
+			if (reachable.find(p.get()) != reachable.end() && postNum.find(p.get()) == postNum.end()) {
+				postNum[p.get()] = -1;
+				S.push(std::make_pair(p, 0));
+			}
+		}
+		else {
+			postNum[top.first.get()] = order.size();
+			order.push_back(top.first);
+			S.pop();
+		}
+	}
+	exactPDT = order.size() == f->getBlockList().size();
+
+	auto intersect = [&](std::shared_ptr<BasicBlock> a, std::shared_ptr<BasicBlock> b) {
+		while (a != b) {
+			while (postNum[a.get()] < postNum[b.get()]) a = ipdom[a.get()];
+			while (postNum[b.get()] < postNum[a.get()]) b = ipdom[b.get()];
+		}
+		return a;
+	};
+
+	ipdom[f->getExit().get()] = f->getExit();
+	bool changed;
+	do
+	{
+		changed = false;
+		for (int k = (int)order.size() - 2; k >= 0; k--) {
+			auto b = order[k];
+			std::shared_ptr<BasicBlock> newIpdom = nullptr;
+			for (auto &s : b->getBlocksTo()) {
+				if (ipdom.find(s.get()) == ipdom.end()) continue;
+				newIpdom = newIpdom == nullptr ? s : intersect(s, newIpdom);
+			}
+			if (ipdom[b.get()] != newIpdom) {
+				ipdom[b.get()] = newIpdom;
+				changed = true;
+			}
+		}
+	} while (changed);
+}
+
+// block y is control dependent on x if y post-dominates a successor of x but not x itself
+void DeadCodeEliminationPass::computeControlDependence(std::shared_ptr<Function> f)
+{
+	controlDeps.clear();
+	if (!exactPDT) return;
+	for (auto &x : f->getBlockList())
+		if (x->getBlocksTo().size() > 1)
+			for (auto &s : x->getBlocksTo())
+				for (auto runner = s; runner != ipdom[x.get()]; runner = ipdom[runner.get()])
+					controlDeps[runner.get()].push_back(x);
+}
+
+void DeadCodeEliminationPass::mark(std::shared_ptr<Function> f)
+{
+	live.clear();
+	liveBlocks.clear();
+	for (auto &b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr())
+			if (isCritical(i)) markLive(i);
+
+	while (!W.empty()) {
+		auto i = W.front();
+		W.pop();
+
+		auto b = i->getBlock();
+		if (liveBlocks.insert(b.get()).second)
+			for (auto &x : controlDeps[b.get()]) markLive(x->getBack());
+
+		if (i->getTag() == IRInstruction::PHI) {
+			// the value also depends on which edge is taken
+			for (auto &option : std::static_pointer_cast<PhiFunction>(i)->getRelatedRegs()) {
+				auto it = def.find(option.first);
+				if (it != def.end()) markLive(it->second);
+				if (option.second.lock() != nullptr) markLive(option.second.lock()->getBack());
+			}
+		}
+		else
+			for (auto &reg : i->getUseRegs()) {
+				auto it = def.find(reg);
+				if (it != def.end()) markLive(it->second);
+			}
+	}
+}
+
+void DeadCodeEliminationPass::markLive(std::shared_ptr<IRInstruction> i)
+{
+	if (live.insert(i).second) W.push(i);
+}
+
+bool DeadCodeEliminationPass::isCritical(std::shared_ptr<IRInstruction> i)
+{
+	switch (i->getTag())
+	{
+	case IRInstruction::RET:
+		return true;
+	case IRInstruction::BRANCH:
+		return !exactPDT;
+	case IRInstruction::QUADR:
+		return std::static_pointer_cast<Quadruple>(i)->getOp() == Quadruple::STORE;
+	case IRInstruction::CALL:
+		return !ir->isPureBuiltin(std::static_pointer_cast<Call>(i)->getFunction());
+	default:
+		return false;
+	}
+}
+
+void DeadCodeEliminationPass::eliminate(std::shared_ptr<Function> f)
+{
+	bool cfgChanged = false;
+	for (auto &b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			if (live.find(i) != live.end() || i->getTag() == IRInstruction::JUMP) continue;
+			changed = true;
+			if (i->getTag() != IRInstruction::BRANCH) {
+				removeInstruction(i);
+				continue;
+			}
+
+			// no live block is control dependent on this branch, skip to the first live post-dominator
+			auto target = ipdom[b.get()];
+			while (liveBlocks.find(target.get()) == liveBlocks.end()) target = ipdom[target.get()];
+			auto successors = b->getBlocksTo();
+			for (auto &s : successors) {
+				for (auto j = s->getFront(); j->getTag() == IRInstruction::PHI; j = j->getNextInstr())
+					std::static_pointer_cast<PhiFunction>(j)->removeOption(b);
+				s->getBlocksFrom().erase(b);
+			}
+			b->getBlocksTo().clear();
+			b->link_to_block(target);
+			auto jump = std::make_shared<Jump>(b, target);
+			replaceInstruction(i, jump);
+			i = jump;
+			cfgChanged = true;
+		}
+
+	if (cfgChanged) removeUnreachableEdges(f);
+}
+
+// blocks skipped by the rewritten branches still appear in the predecessor lists
+void DeadCodeEliminationPass::removeUnreachableEdges(std::shared_ptr<Function> f)
+{
+	updateDTinfo(f);
+	std::set<BasicBlock *> reachable;
+	for (auto &b : f->getBlockList()) reachable.insert(b.get());
+	for (auto &b : f->getBlockList()) {
+		auto preds = b->getBlocksFrom();
+		for (auto &p : preds)
+			if (reachable.find(p.get()) == reachable.end()) {
+				for (auto i = b->getFront(); i->getTag() == IRInstruction::PHI; i = i->getNextInstr())
+					std::static_pointer_cast<PhiFunction>(i)->removeOption(p);
+				b->getBlocksFrom().erase(p);
+			}
+	}
 }
@@ -1,7 +1,16 @@
 #pragma once
 #include "pch.h"
 #include "cfg_pass.h"
+#include <queue>
 
+/*
+Aggressive dead code elimination on SSA form.
+Stores, returns and calls with side effects are live from the start, liveness
+then flows backwards along the def-use chains and to the branches a live block
+is control dependent on (computed with the post-dominator tree). Everything
+else is removed, and a branch that is not live becomes a jump to its nearest
+live post-dominator.
+*/
 class DeadCodeEliminationPass : public CFG_Pass {
 public:
 	DeadCodeEliminationPass(std::shared_ptr<IR> ir) :CFG_Pass(ir) {}
@@ -9,7 +18,24 @@ public:
 	bool run() override;
 
 private:
+	bool changed;
 
-	void eliminate(std::shared_ptr<Function> f);
+	// false if some block cannot reach the exit (e.g. an infinite loop),
+	// then the post-dominator tree is partial and every branch is kept
+	bool exactPDT;
+	std::map<BasicBlock *, std::shared_ptr<BasicBlock> > ipdom;
+	std::map<BasicBlock *, std::vector<std::shared_ptr<BasicBlock> > > controlDeps;
+
+	std::set<std::shared_ptr<IRInstruction> > live;
+	std::set<BasicBlock *> liveBlocks;
+	std::queue<std::shared_ptr<IRInstruction> > W;
 
+	void computePostDominators(std::shared_ptr<Function> f);
+	void computeControlDependence(std::shared_ptr<Function> f);
+	void mark(std::shared_ptr<Function> f);
+	void markLive(std::shared_ptr<IRInstruction> i);
+	bool isCritical(std::shared_ptr<IRInstruction> i);
+
+	void eliminate(std::shared_ptr<Function> f);
+	void removeUnreachableEdges(std::shared_ptr<Function> f);
 };
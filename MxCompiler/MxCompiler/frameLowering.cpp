@@ -0,0 +1,316 @@
+#include "frameLowering.h"
+
+void FrameLowering::removeUnusedSaves()
+{
+	for (auto &function : program->getFunctions()) {
+		f = function;
+		findSaves();
+
+		// a backup is needed if anything but its own save and restore touches the register,
+		// including the backup of another register held in it (ra is often kept in an s-register)
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (size_t k = 0; k < saves.size(); k++) {
+				bool touched = false;
+				for (auto &b : f->getBlockList())
+					for (auto i = b->getFront(); i != nullptr && !touched; i = i->getNextInstr()) {
+						if (i == saves[k].save || i == saves[k].restore) continue;
+						for (auto &reg : touchedRegs(i))
+							if (reg == saves[k].reg) touched = true;
+					}
+				if (touched) continue;
+				removeRISCVinstruction(saves[k].save);
+				removeRISCVinstruction(saves[k].restore);
+				saves.erase(saves.begin() + k);
+				changed = true;
+				break;
+			}
+		}
+	}
+}
+
+void FrameLowering::run()
+{
+	for (auto &function : program->getFunctions()) {
+		f = function;
+		findSaves();
+		if (saves.empty() && f->getStackSize() == 0) continue;
+
+		auto entry = f->getEntry(), exit = f->getExit();
+		f->computeLoopDepth();
+		auto dom = f->computeDominators(), pdom = f->computeDominators(true);
+		auto commonAncestor = [](std::map<RISCVBasicBlock *, RISCVBasicBlock *> &tree, RISCVBasicBlock *x, RISCVBasicBlock *y) {
+			std::set<RISCVBasicBlock *> ancestors{ x };
+			while (tree[x] != x) ancestors.insert(x = tree[x]);
+			while (ancestors.find(y) == ancestors.end() && tree[y] != y) y = tree[y];
+			return ancestors.find(y) != ancestors.end() ? y : nullptr;
+		};
+		auto isAncestor = [](std::map<RISCVBasicBlock *, RISCVBasicBlock *> &tree, RISCVBasicBlock *x, RISCVBasicBlock *y) {
+			while (y != x && tree[y] != y) y = tree[y];
+			return y == x;
+		};
+
+		// the blocks that need the frame, with the entry block left out if its argument copies can be sunk
+		std::vector<std::shared_ptr<MoveAssembly> > copies;
+		bool sinkable = sinkableArgumentCopies(copies, false);
+		std::vector<std::shared_ptr<RISCVBasicBlock> > users;
+		for (auto &b : f->getBlockList()) {
+			if (b == entry && sinkable) continue;
+			for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr())
+				if (needsFrame(i)) {
+					users.push_back(b);
+					break;
+				}
+		}
+
+		std::shared_ptr<RISCVBasicBlock> prologue = entry, epilogue = exit;
+		RISCVBasicBlock *s = nullptr, *r = nullptr;
+		bool unreachable = false;
+		for (auto &b : users) {
+			if (dom.find(b.get()) == dom.end() || pdom.find(b.get()) == pdom.end()) unreachable = true;
+			else {
+				s = s == nullptr ? b.get() : commonAncestor(dom, s, b.get());
+				r = r == nullptr ? b.get() : commonAncestor(pdom, r, b.get());
+			}
+		}
+		if (!unreachable && s != nullptr && r != nullptr && s->getLoopDepth() == 0 && r->getLoopDepth() == 0
+			&& isAncestor(dom, s, r) && isAncestor(pdom, r, s)) {
+			for (auto &b : f->getBlockList()) {
+				if (b.get() == s) prologue = b;
+				if (b.get() == r) epilogue = b;
+			}
+			// the restores go before the branches at the end of the epilogue
+			for (auto i = epilogue->getBack(); i != nullptr; i = i->getPrevInstr()) {
+				auto c = i->category();
+				if (c != RISCVinstruction::JUMP && c != RISCVinstruction::BTYPE && c != RISCVinstruction::RET) break;
+				if (epilogue != exit && needsFrame(i)) prologue = entry;
+			}
+		}
+		// sunk copies need the argument registers untouched up to the prologue
+		if (prologue != entry && !copies.empty()
+			&& (prologue->getFromBlocks().size() != 1 || *prologue->getFromBlocks().begin() != entry))
+			prologue = entry;
+		if (prologue == entry) {
+			epilogue = exit;
+			copies.clear();
+		}
+		else sinkableArgumentCopies(copies, true);
+
+		place(prologue, epilogue, copies);
+	}
+}
+
+void FrameLowering::findSaves()
+{
+	saves.clear();
+	frameCode.clear();
+	std::set<std::shared_ptr<Register> > calleeSave{ (*program)["ra"] };
+	for (auto regName : RISCVConfig::calleeSaveRegNames) calleeSave.insert((*program)[regName]);
+	std::set<StackLocation *> spillSlots;
+	for (auto &slot : f->getSpillSlots()) spillSlots.insert(slot.get());
+
+	// backups of registers not written before, in the entry block
+	std::vector<Save> candidates;
+	std::set<std::shared_ptr<Register> > written;
+	auto known = [&](std::shared_ptr<Register> reg) {
+		for (auto &c : candidates) if (c.reg == reg) return true;
+		return false;
+	};
+	for (auto i = f->getEntry()->getFront(); i != nullptr; i = i->getNextInstr()) {
+		if (i->category() == RISCVinstruction::STORE) {
+			auto s = std::static_pointer_cast<Store>(i);
+			auto slot = stackAddr(i);
+			if (slot != nullptr && spillSlots.count(slot.get()) && s->getRt() == nullptr
+				&& calleeSave.count(s->getRs()) && !written.count(s->getRs()) && !known(s->getRs()))
+				candidates.push_back({ s->getRs(), nullptr, slot, i, nullptr });
+		}
+		else if (i->category() == RISCVinstruction::MOV) {
+			auto m = std::static_pointer_cast<MoveAssembly>(i);
+			if (calleeSave.count(m->getRs1()) && !written.count(m->getRs1()) && !known(m->getRs1())
+				&& m->getRd()->category() == Operand::PHISICAL && m->getRd() != m->getRs1())
+				candidates.push_back({ m->getRs1(), m->getRd(), nullptr, i, nullptr });
+		}
+		if (i->getDefReg() != nullptr) written.insert(i->getDefReg());
+		if (i->category() == RISCVinstruction::CALL) break;
+	}
+
+	// their restores: the last writes before ret, in the exit block
+	written.clear();
+	for (auto i = f->getExit()->getBack(); i != nullptr; i = i->getPrevInstr()) {
+		for (auto &c : candidates) {
+			if (c.restore != nullptr || written.count(c.reg)) continue;
+			if (c.slot != nullptr && i->category() == RISCVinstruction::LOAD
+				&& stackAddr(i) == c.slot && std::static_pointer_cast<Load>(i)->getRd() == c.reg)
+				c.restore = i;
+			if (c.holder != nullptr && i->category() == RISCVinstruction::MOV
+				&& std::static_pointer_cast<MoveAssembly>(i)->getRd() == c.reg
+				&& std::static_pointer_cast<MoveAssembly>(i)->getRs1() == c.holder)
+				c.restore = i;
+		}
+		if (i->getDefReg() != nullptr) written.insert(i->getDefReg());
+		if (i->category() == RISCVinstruction::CALL) break;
+	}
+	for (auto &c : candidates)
+		if (c.restore != nullptr && c.save != c.restore) {
+			saves.push_back(c);
+			frameCode.insert(c.save.get());
+			frameCode.insert(c.restore.get());
+		}
+
+	// the slot or holder must not be touched by anything else
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t k = 0; k < saves.size() && !changed; k++) {
+			for (auto &b : f->getBlockList())
+				for (auto i = b->getFront(); i != nullptr && !changed; i = i->getNextInstr()) {
+					if (i == saves[k].save || i == saves[k].restore) continue;
+					if (saves[k].slot != nullptr && stackAddr(i) == saves[k].slot) changed = true;
+					if (saves[k].holder != nullptr && !frameCode.count(i.get()))
+						for (auto &reg : touchedRegs(i))
+							if (reg == saves[k].holder) changed = true;
+				}
+			if (changed) {
+				frameCode.erase(saves[k].save.get());
+				frameCode.erase(saves[k].restore.get());
+				saves.erase(saves.begin() + k);
+			}
+		}
+	}
+}
+
+bool FrameLowering::isSaved(std::shared_ptr<Register> reg)
+{
+	for (auto &s : saves)
+		if (s.reg == reg || s.holder == reg) return true;
+	return false;
+}
+
+bool FrameLowering::needsFrame(std::shared_ptr<RISCVinstruction> i)
+{
+	if (frameCode.count(i.get())) return false;
+	if (stackAddr(i) != nullptr) return true;
+	for (auto &reg : touchedRegs(i))
+		if (isSaved(reg)) return true;
+	return false;
+}
+
+bool FrameLowering::sinkableArgumentCopies(std::vector<std::shared_ptr<MoveAssembly> > &copies, bool rewrite)
+{
+	// every use of the frame in the entry block has to be a copy "mv s, a" of an argument register,
+	// or a read of such an s after its copy, while neither s nor a is written again
+	copies.clear();
+	std::map<std::shared_ptr<Register>, std::shared_ptr<Register> > copied;
+	for (auto i = f->getEntry()->getFront(); i != nullptr; i = i->getNextInstr()) {
+		if (!needsFrame(i)) {
+			auto def = i->getDefReg();
+			for (auto &it : copied)
+				if (def == it.first || def == it.second) return false;
+			if (i->category() == RISCVinstruction::CALL) return false;
+			continue;
+		}
+		if (stackAddr(i) != nullptr) return false;
+
+		if (i->category() == RISCVinstruction::MOV) {
+			auto m = std::static_pointer_cast<MoveAssembly>(i);
+			auto name = m->getRs1()->getName();
+			if (m->getRs1()->category() == Operand::PHISICAL && name.size() == 2 && name[0] == 'a'
+				&& isSaved(m->getRd()) && !isSaved(m->getRs1()) && copied.find(m->getRd()) == copied.end()) {
+				for (auto &it : copied)
+					if (m->getRd() == it.second) return false;
+				copied[m->getRd()] = m->getRs1();
+				copies.push_back(m);
+				continue;
+			}
+		}
+		if (i->getDefReg() != nullptr && isSaved(i->getDefReg())) return false;
+		for (auto &it : copied)
+			if (i->getDefReg() == it.second) return false;
+		for (auto &reg : i->getUseReg())
+			if (isSaved(reg) && copied.find(reg) == copied.end()) return false;
+		if (rewrite)
+			for (auto &it : copied) i->updateUseReg(it.first, it.second);
+	}
+	return true;
+}
+
+void FrameLowering::place(std::shared_ptr<RISCVBasicBlock> prologue, std::shared_ptr<RISCVBasicBlock> epilogue,
+	const std::vector<std::shared_ptr<MoveAssembly> > &copies)
+{
+	int stackSize = f->getStackSize();
+	auto sp = (*program)["sp"];
+	auto entry = f->getEntry(), exit = f->getExit();
+
+	if (prologue == entry && epilogue == exit) {
+		if (stackSize > 0) {
+			appendBefore(entry->getFront(), std::make_shared<I_type>(
+				entry, I_type::ADDI, sp, sp, std::make_shared<Immediate>(-stackSize)));
+			appendBefore(exit->getBack(), std::make_shared<I_type>(
+				exit, I_type::ADDI, sp, sp, std::make_shared<Immediate>(stackSize)));
+		}
+		return;
+	}
+
+	// rebuild the frame code in its new blocks, in the original order
+	std::vector<std::shared_ptr<RISCVinstruction> > enter, leave;
+	if (stackSize > 0)
+		enter.push_back(std::make_shared<I_type>(prologue, I_type::ADDI, sp, sp, std::make_shared<Immediate>(-stackSize)));
+	for (auto i = entry->getFront(); i != nullptr; i = i->getNextInstr())
+		for (auto &s : saves)
+			if (i == s.save) {
+				if (s.slot != nullptr)
+					enter.push_back(std::make_shared<Store>(prologue, s.slot, s.reg, Configuration::SIZE_OF_INT));
+				else enter.push_back(std::make_shared<MoveAssembly>(prologue, s.holder, s.reg));
+			}
+	for (auto &c : copies) enter.push_back(std::make_shared<MoveAssembly>(prologue, c->getRd(), c->getRs1()));
+	for (auto i = exit->getFront(); i != nullptr; i = i->getNextInstr())
+		for (auto &s : saves)
+			if (i == s.restore) {
+				if (s.slot != nullptr)
+					leave.push_back(std::make_shared<Load>(epilogue, s.slot, s.reg, Configuration::SIZE_OF_INT));
+				else leave.push_back(std::make_shared<MoveAssembly>(epilogue, s.reg, s.holder));
+			}
+	if (stackSize > 0)
+		leave.push_back(std::make_shared<I_type>(epilogue, I_type::ADDI, sp, sp, std::make_shared<Immediate>(stackSize)));
+
+	for (auto &s : saves) {
+		removeRISCVinstruction(s.save);
+		removeRISCVinstruction(s.restore);
+	}
+	for (auto &c : copies) removeRISCVinstruction(c);
+
+	auto front = prologue->getFront();
+	for (auto &i : enter) {
+		if (front != nullptr) appendBefore(front, i);
+		else prologue->append(i);
+	}
+	std::shared_ptr<RISCVinstruction> branch;
+	for (auto i = epilogue->getBack(); i != nullptr; i = i->getPrevInstr()) {
+		auto c = i->category();
+		if (c != RISCVinstruction::JUMP && c != RISCVinstruction::BTYPE && c != RISCVinstruction::RET) break;
+		branch = i;
+	}
+	for (auto &i : leave) {
+		if (branch != nullptr) appendBefore(branch, i);
+		else epilogue->append(i);
+	}
+}
+
+std::vector<std::shared_ptr<Register> > FrameLowering::touchedRegs(std::shared_ptr<RISCVinstruction> i)
+{
+	auto regs = i->getUseReg();
+	if (i->getDefReg() != nullptr) regs.push_back(i->getDefReg());
+	if (i->category() == RISCVinstruction::CALL)
+		for (auto regName : RISCVConfig::callerSaveRegNames) regs.push_back((*program)[regName]);
+	return regs;
+}
+
+std::shared_ptr<StackLocation> FrameLowering::stackAddr(std::shared_ptr<RISCVinstruction> i)
+{
+	std::shared_ptr<Address> addr;
+	if (i->category() == RISCVinstruction::LOAD) addr = std::static_pointer_cast<Load>(i)->getAddr();
+	else if (i->category() == RISCVinstruction::STORE) addr = std::static_pointer_cast<Store>(i)->getAddr();
+	if (addr == nullptr || addr->category() != Operand::STACK) return nullptr;
+	return std::static_pointer_cast<StackLocation>(addr);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "pch.h"
+#include "RISCVassembly.h"
+#include "configuration.h"
+
+/*
+Class: FrameLowering
+Places the stack frame and the callee-save code of every function; it runs
+after register allocation and replaces the fixed prologue/epilogue.
+The instruction selector backs up ra and s0-s11 in virtual registers on entry
+and restores them before ret; after allocation such a backup is either gone
+(coalesced), a move to another register, or a spill to the stack.
+- A backup whose register is never touched otherwise is deleted, so a leaf
+  function keeps neither ra nor an unused s-register.
+- The other backups and the sp adjustment move together from the entry and
+  exit blocks to a single-entry single-exit region (shrink-wrapping): they go
+  to the nearest dominator and post-dominator of the blocks that use a saved
+  register or the stack, if both are outside of loops. The argument copies into
+  saved registers are sunk into the region when that keeps the entry block out
+  of it, so an early return (the base case of a recursion) needs no frame.
+*/
+class FrameLowering {
+public:
+	FrameLowering(std::shared_ptr<RISCVProgram> _program) :program(_program) {}
+
+	// deletes the backups that are not needed, before the stack slots are laid out
+	void removeUnusedSaves();
+	// places the frame and the remaining backups
+	void run();
+
+private:
+	// a backup of <reg> on entry and its restore before ret; <holder> keeps the
+	// value of a move, <slot> the one of a store
+	struct Save {
+		std::shared_ptr<Register> reg, holder;
+		std::shared_ptr<StackLocation> slot;
+		std::shared_ptr<RISCVinstruction> save, restore;
+	};
+
+	std::shared_ptr<RISCVProgram> program;
+	std::shared_ptr<RISCVFunction> f;
+	std::vector<Save> saves;
+	std::set<RISCVinstruction *> frameCode;  // the save and restore instructions
+
+	void findSaves();
+	bool isSaved(std::shared_ptr<Register> reg);
+	// whether <i> (not part of the frame code) touches a saved register or the stack
+	bool needsFrame(std::shared_ptr<RISCVinstruction> i);
+	// whether the entry block only needs the frame for copies of argument registers
+	// (collected in <copies>); with <rewrite> the later reads use the arguments instead
+	bool sinkableArgumentCopies(std::vector<std::shared_ptr<MoveAssembly> > &copies, bool rewrite);
+
+	void place(std::shared_ptr<RISCVBasicBlock> prologue, std::shared_ptr<RISCVBasicBlock> epilogue,
+		const std::vector<std::shared_ptr<MoveAssembly> > &copies);
+
+	std::vector<std::shared_ptr<Register> > touchedRegs(std::shared_ptr<RISCVinstruction> i);
+	static std::shared_ptr<StackLocation> stackAddr(std::shared_ptr<RISCVinstruction> i);
+};
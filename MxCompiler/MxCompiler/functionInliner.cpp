@@ -2,228 +2,239 @@
 
 bool FunctionInliner::run()
 {
+	changed = false;
 	prepare();
-	non_recursive();
-	recursive();
-	return true;
+	for (auto &component : bottomUpComponents()) {
+		std::set<std::shared_ptr<Function> > members(component.begin(), component.end());
+		for (auto &f : component) inlineCallsIn(f, members);
+	}
+	if (changed) removeUnreachableFunctions();
+	return changed;
 }
 
 void FunctionInliner::prepare()
 {
+	computeRecursiveCalleeSet();
 	call_cnt.clear();
 	for (auto &f : ir->getFunctions()) {
-		int cnt = 0;
-		for(auto b : f->getBlockList())
-			for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
-				cnt++;
-				if (i->getTag() == IRInstruction::CALL) 
+		for (auto &b : f->getBlockList())
+			for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr())
+				if (i->getTag() == IRInstruction::CALL)
 					call_cnt[std::static_pointer_cast<Call>(i)->getFunction()]++;
-			}
-
-		instr_cnt[f] = cnt;
+		measure(f);
 	}
 }
 
-void FunctionInliner::non_recursive()
+void FunctionInliner::measure(std::shared_ptr<Function> f)
 {
-	bool changed;
-	do
-	{
-		changed = false;
-		for (auto &f : ir->getFunctions()) {
-			for(auto &b : f->getBlockList())
-				for (auto i = b->getFront(); i != nullptr;) {
-					if (i->getTag() == IRInstruction::CALL) {
-						auto call = std::static_pointer_cast<Call>(i);
-						if (okForInlining(call->getFunction())) {
-							changed = true;
-							i = expand(call);
-							instr_cnt[f] += instr_cnt[call->getFunction()];
-							call_cnt[call->getFunction()]--;
-						}
-						else i = i->getNextInstr();
-					}
-					else i = i->getNextInstr();
-
-				}
-			updateDTinfo(f);
-		}
-	} while (changed);
-
-	for (auto it : call_cnt)
-		if (it.second == 0 && it.first->getName() != "__bootstrap")
-			ir->omitFunction(it.first);
+	int cnt = 0;
+	for (auto &b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr())
+			if (i->getTag() != IRInstruction::PHI && i->getTag() != IRInstruction::JUMP) cnt++;
+	instr_cnt[f] = cnt;
+
+	resolveDefineUseChain(f);
+	auto &uses = argUses[f];
+	uses.clear();
+	for (auto &arg : f->getArgs()) uses.push_back(use[arg].size());
+	if (f->getObjRef() != nullptr)
+		uses.push_back(use[std::static_pointer_cast<Register>(f->getObjRef())].size());
 }
 
-void FunctionInliner::recursive()
+std::vector<std::vector<std::shared_ptr<Function> > > FunctionInliner::bottomUpComponents()
 {
-	bool changed;
-	int depth = 0;
-	do
-	{
-		changed = false;
-		createShadows();
-
-		for (auto &f : ir->getFunctions()) {
-			for(auto &b : f->getBlockList())
-				for (auto i = b->getFront(); i != nullptr;) {
-					if (i->getTag() == IRInstruction::CALL) {
-						auto call = std::static_pointer_cast<Call>(i);
-						if (okForRecursivelyInlining(call->getFunction())) {
-							changed = true;
-							i = expand(call);
-							instr_cnt[f] += instr_cnt[call->getFunction()];
-						}
-						else i = i->getNextInstr();
-					}
-					else i = i->getNextInstr();
-
-				}
-			updateDTinfo(f);
+	auto &functions = ir->getFunctions();
+	std::set<std::shared_ptr<Function> > userFunctions(functions.begin(), functions.end()), done;
+	std::vector<std::vector<std::shared_ptr<Function> > > order;
+
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		for (auto &f : functions) {
+			if (done.find(f) != done.end()) continue;
+			// f and the functions that both call and are called by f
+			std::vector<std::shared_ptr<Function> > component{ f };
+			for (auto &g : recursiveCalleeSet[f])
+				if (g != f && recursiveCalleeSet[g].find(f) != recursiveCalleeSet[g].end()) component.push_back(g);
+
+			bool ready = true;
+			for (auto &g : component)
+				for (auto &callee : calleeSet[g])
+					if (userFunctions.find(callee) != userFunctions.end() && done.find(callee) == done.end()
+						&& std::find(component.begin(), component.end(), callee) == component.end())
+						ready = false;
+			if (!ready) continue;
+
+			progress = true;
+			done.insert(component.begin(), component.end());
+			order.push_back(component);
 		}
-		depth++;
-	} while (changed && depth < MAX_INLINING_DEPTH);
-
-	computeRecursiveCalleeSet();
+	}
+	return order;
 }
 
-std::shared_ptr<IRInstruction> FunctionInliner::expand(std::shared_ptr<Call> c)
+void FunctionInliner::inlineCallsIn(std::shared_ptr<Function> f, const std::set<std::shared_ptr<Function> > &component)
 {
-	std::shared_ptr<Function> callee = shadows[c->getFunction()], caller = c->getBlock()->getFunction();
-	auto calling_block = c->getBlock();
-
-	auto splitter = std::make_shared<BasicBlock>(caller, BasicBlock::SPLITTER);
-	for (auto to_block : calling_block->getBlocksTo()) to_block->replaceBlockTo(calling_block, splitter);
-
-	std::vector<std::shared_ptr<IRInstruction> > afterCall;
-	while (calling_block->getBack() != c) {
-		afterCall.push_back(calling_block->getBack());
-		calling_block->remove_back(); // be careful when removing back()
-	}
+	updateDTinfo(f);
+	auto nest = std::make_shared<LoopNest>(f);
+
+	std::vector<std::pair<std::shared_ptr<Call>, int> > sites;
+	for (auto &b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr())
+			if (i->getTag() == IRInstruction::CALL) {
+				auto c = std::static_pointer_cast<Call>(i);
+				if (component.find(c->getFunction()) == component.end() && okForInlining(c->getFunction()))
+					sites.push_back(std::make_pair(c, nest->getLoopDepth(b)));
+			}
 
-	for (int j = afterCall.size() - 1; j >= 0; j--) {
-		auto i = afterCall[j];
-		i->setBlock(splitter);
-		if (i->getTag() == IRInstruction::JUMP || i->getTag() == IRInstruction::BRANCH || i->getTag() || i->getTag() == IRInstruction::RET) {
-			splitter->endWith(i);
-		}
-		else splitter->append_back(i);
+	bool inlined = false;
+	for (auto &site : sites) {
+		auto c = site.first;
+		auto callee = c->getFunction();
+		if (inlineCost(c) > threshold(c, site.second) || instr_cnt[f] + instr_cnt[callee] > MAX_CALLER_SIZE)
+			continue;
+
+		expand(c);
+		inlined = true;
+		instr_cnt[f] += instr_cnt[callee];
+		call_cnt[callee]--;
+		for (auto &b : callee->getBlockList())
+			for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr())
+				if (i->getTag() == IRInstruction::CALL)
+					call_cnt[std::static_pointer_cast<Call>(i)->getFunction()]++;
 	}
-	splitter->getFront()->setNextInstr(nullptr);
-
-	shadowBlocks.clear();
-	globalVarInit();
 
-	shadowBlocks[callee->getEntry()] = calling_block;
-	shadowBlocks[callee->getExit()] = splitter;
-	if (caller->getExit() == calling_block) caller->setExit(splitter);
-
-	// copy argments
-	for (auto arg : c->getArgs()) {
-		auto new_arg = std::make_shared<VirtualReg>();
-		appendInstrBefore(c, std::make_shared<Quadruple>(c->getBlock(), Quadruple::MOVE, new_arg, arg));
-		shadowOperands[arg] = new_arg;
+	if (inlined) {
+		changed = true;
+		updateDTinfo(f);
+		measure(f);
 	}
-	removeInstruction(c);
-
-	for (auto &b : callee->getBlockList())
-		if(shadowBlocks.find(b) == shadowBlocks.end())  // entry and exit are already set
-			shadowBlocks[b] = std::make_shared<BasicBlock>(caller, BasicBlock::SHADOW);
-
-	auto front_of_spilitter = splitter->getFront();
-	for (auto &b : callee->getBlockList()) {
-		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
-			for (auto use : i->getUseRegs()) setShadowOperand(use);
-			if (i->getDefReg() != nullptr) setShadowOperand(i->getDefReg());
+}
 
-			if (shadowBlocks[b] == splitter) {  // the exit of callee
-				if (i != b->getBack())   // ignore the return instruction
-					appendInstrBefore(front_of_spilitter, i->makeShadow(shadowBlocks, shadowOperands));
-			}
-			else {
-				auto shadowInstr = i->makeShadow(shadowBlocks, shadowOperands);
-				if (i == b->getBack())
-					shadowBlocks[b]->endWith(shadowInstr);
-				else shadowBlocks[b]->append_back(shadowInstr);
-			}
+void FunctionInliner::removeUnreachableFunctions()
+{
+	computeRecursiveCalleeSet();
+	std::set<std::shared_ptr<Function> > live;
+	for (auto &f : ir->getFunctions())
+		if (f->getName() == "main" || f->getName() == "__bootstrap") {
+			live.insert(f);
+			live.insert(recursiveCalleeSet[f].begin(), recursiveCalleeSet[f].end());
 		}
-	}
-
-	if (!calling_block->ended())
-		calling_block->endWith(std::make_shared<Jump>(calling_block, splitter));
 
-	// return
-	auto ret = std::static_pointer_cast<Return>(callee->getExit()->getBack());
-	if (ret->getValue() != nullptr) {
-		std::shared_ptr<Operand> return_value = ret->getValue();
-		if (shadowOperands.find(return_value) != shadowOperands.end()) return_value = shadowOperands[return_value];
-		appendInstrBefore(front_of_spilitter, std::make_shared<Quadruple>(
-			splitter, Quadruple::MOVE, c->getResult(), return_value));
-	}
-	return front_of_spilitter;
+	auto functions = ir->getFunctions();
+	for (auto &f : functions)
+		if (live.find(f) == live.end()) ir->omitFunction(f);
 }
 
 bool FunctionInliner::okForInlining(std::shared_ptr<Function> f)
 {
-	if (f->getObjRef() != nullptr) return false; // class method
-	if (call_cnt[f] == 0) return false;
-	return instr_cnt[f] <= INLINE_THRESHOLD;
+	auto &functions = ir->getFunctions();
+	if (std::find(functions.begin(), functions.end(), f) == functions.end()) return false;  // builtin
+	if (f->getName() == "main" || f->getName() == "__bootstrap") return false;
+
+	// the entry is merged into the calling block and the exit into the one after the call
+	if (!f->getEntry()->getBlocksFrom().empty()) return false;
+	auto exit = f->getExit();
+	if (exit == nullptr || exit->getBack() == nullptr || exit->getBack()->getTag() != IRInstruction::RET)
+		return false;
+	auto &blocks = f->getBlockList();
+	return std::find(blocks.begin(), blocks.end(), exit) != blocks.end();
 }
 
-bool FunctionInliner::okForRecursivelyInlining(std::shared_ptr<Function> f)
+int FunctionInliner::inlineCost(std::shared_ptr<Call> c)
 {
-	if (recursiveCalleeSet[f].find(f) != recursiveCalleeSet[f].end()) return false; //recursive;
-	return okForInlining(f);
+	auto callee = c->getFunction();
+	auto args = c->getArgs();
+	if (c->getObjRef() != nullptr) args.push_back(c->getObjRef());
+
+	auto &uses = argUses[callee];
+	int cost = instr_cnt[callee] - CALL_OVERHEAD - (int)args.size();
+	for (size_t k = 0; k < args.size() && k < uses.size(); k++)
+		if (args[k]->category() == Operand::IMM) cost -= CONST_ARG_BONUS * uses[k];
+	return cost;
 }
 
-void FunctionInliner::createShadows()
+int FunctionInliner::threshold(std::shared_ptr<Call> c, int loopDepth)
 {
-	shadows.clear();
-	for (auto &f : ir->getFunctions())
-		if (recursiveCalleeSet[f].find(f) != recursiveCalleeSet[f].end())
-			shadows[f] = createShadowFunction(f);
-		else shadows[f] = f;  // no need to create a shadow
+	int limit = BASE_THRESHOLD + LOOP_BONUS * std::min(loopDepth, (int)MAX_LOOP_DEPTH);
+	// the callee disappears afterwards
+	if (call_cnt[c->getFunction()] == 1) limit = std::max(limit, (int)SINGLE_CALL_THRESHOLD);
+	return limit;
 }
 
-std::shared_ptr<Function> FunctionInliner::createShadowFunction(std::shared_ptr<Function> f)
+void FunctionInliner::expand(std::shared_ptr<Call> c)
 {
-	auto shadow = std::make_shared<Function>("__shadow_" + f->getName(), nullptr); // is this ok?
+	auto callee = c->getFunction();
+	auto b = c->getBlock();
+	auto caller = b->getFunction();
 
-	// no shadow blocks and registers now
-	shadowBlocks.clear();
+	// formals are bound to the actual arguments, everything defined in the callee is renamed
 	shadowOperands.clear();
+	shadowBlocks.clear();
+	auto args = c->getArgs();
+	for (size_t k = 0; k < args.size(); k++) shadowOperands[callee->getArgs()[k]] = bindArgument(c, args[k]);
+	if (callee->getObjRef() != nullptr) shadowOperands[callee->getObjRef()] = bindArgument(c, c->getObjRef());
+	for (auto &bb : callee->getBlockList())
+		for (auto i = bb->getFront(); i != nullptr; i = i->getNextInstr())
+			if (i->getDefReg() != nullptr) shadowOperands[i->getDefReg()] = std::make_shared<VirtualReg>();
+
+	// the instructions after the call move to the splitter, which takes over the successors
+	auto splitter = std::make_shared<BasicBlock>(caller, BasicBlock::SPLITTER);
+	for (auto &s : b->getBlocksTo()) {
+		s->replaceBlockFrom(b, splitter);
+		for (auto i = s->getFront(); i != nullptr && i->getTag() == IRInstruction::PHI; i = i->getNextInstr())
+			for (auto &option : std::static_pointer_cast<PhiFunction>(i)->getRelatedRegs())
+				if (option.second.lock() == b) option.second = splitter;
+	}
+	b->getBlocksTo().clear();
+	if (caller->getExit() == b) caller->setExit(splitter);
 
-	auto blocks = f->getBlockList();
-	for (auto &b : blocks) shadowBlocks[b] = std::make_shared<BasicBlock>(f, b->getTag());
-	for (auto &b : blocks) {
-		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
-			if (i == b->getBack()) shadowBlocks[b]->endWith(i->makeShadow(shadowBlocks, shadowOperands));
-			else shadowBlocks[b]->append_back(i->makeShadow(shadowBlocks, shadowOperands));
-			//return instructions are not added to shadow function!
+	std::vector<std::shared_ptr<IRInstruction> > afterCall;
+	for (auto i = c->getNextInstr(); i != nullptr; i = i->getNextInstr()) afterCall.push_back(i);
+	c->setNextInstr(nullptr);
+	b->setBack(c);
+	for (auto &i : afterCall) {
+		i->setPreviousInstr(nullptr);
+		i->setNextInstr(nullptr);
+		i->setBlock(splitter);
+		if (i == afterCall.back()) splitter->endWith(i);
+		else splitter->append_back(i);
+	}
+
+	// copy the body: its entry continues the calling block, its exit becomes the splitter
+	for (auto &bb : callee->getBlockList())
+		shadowBlocks[bb] = std::make_shared<BasicBlock>(caller, BasicBlock::SHADOW);
+	shadowBlocks[callee->getEntry()] = b;
+	shadowBlocks[callee->getExit()] = splitter;
+
+	auto frontOfSplitter = splitter->getFront();
+	for (auto &bb : callee->getBlockList()) {
+		auto target = shadowBlocks[bb];
+		for (auto i = bb->getFront(); i != nullptr; i = i->getNextInstr()) {
+			if (i->getTag() == IRInstruction::RET) continue;
+			auto shadow = i->makeShadow(shadowBlocks, shadowOperands);
+			if (target == splitter) appendInstrBefore(frontOfSplitter, shadow);
+			else if (i == bb->getBack()) target->endWith(shadow);
+			else target->append_back(shadow);
 		}
 	}
-	shadow->setEntry(shadowBlocks[f->getEntry()]);
-	shadow->setExit(shadowBlocks[f->getExit()]);
-	shadow->setObjRef(f->getObjRef());
-	shadow->getArgs() = f->getArgs();
-	shadow->setDT(std::make_shared<DominatorTree>(shadow, true));
-	return shadow;
-}
 
-void FunctionInliner::setShadowOperand(std::shared_ptr<Operand> op)
-{
-	if (shadowOperands.find(op) == shadowOperands.end())
-		shadowOperands[op] = std::make_shared<VirtualReg>();
+	auto ret = std::static_pointer_cast<Return>(callee->getExit()->getBack());
+	if (c->getResult() != nullptr && ret->getValue() != nullptr) {
+		auto value = ret->getValue();
+		if (shadowOperands.find(value) != shadowOperands.end()) value = shadowOperands[value];
+		appendInstrBefore(frontOfSplitter, std::make_shared<Quadruple>(splitter, Quadruple::MOVE, c->getResult(), value));
+	}
+	removeInstruction(c);
+	if (callee->getEntry() == callee->getExit())
+		b->endWith(std::make_shared<Jump>(b, splitter));
 }
 
-void FunctionInliner::globalVarInit()
+std::shared_ptr<Operand> FunctionInliner::bindArgument(std::shared_ptr<Call> c, std::shared_ptr<Operand> actual)
 {
-	shadowOperands.clear();
-	for (auto var : ir->getGlbVars()) {
-		auto new_reg = std::make_shared<VirtualReg>();
-		new_reg->markAsGlobal();
-		shadowOperands[var] = new_reg;
-	}
-	for (auto str : ir->getStringConstants())
-		shadowOperands[str->getReg()] = str->getReg();
+	if (Operand::isRegister(actual->category())) return actual;
+	// phi-functions only take registers
+	auto reg = std::make_shared<VirtualReg>();
+	appendInstrBefore(c, std::make_shared<Quadruple>(c->getBlock(), Quadruple::MOVE, reg, actual));
+	return reg;
 }
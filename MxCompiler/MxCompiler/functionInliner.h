@@ -5,39 +5,51 @@
 #include "IRinstruction.h"
 #include "basicblock.h"
 #include "cfg_pass.h"
-
+#include "loop.h"
+
+/*
+Class: FunctionInliner
+Inlines calls on SSA form, after the first round of scalar optimizations so
+that callee sizes are the optimized ones.
+The strongly connected components of the call graph (c.f. computeRecursiveCalleeSet)
+are visited bottom-up: when a function is processed, every callee outside its
+component is already final. Calls inside a component are never inlined.
+A call site is expanded when
+	size(callee) - CONST_ARG_BONUS * (uses of the formals bound to immediates) - CALL_OVERHEAD
+is at most BASE_THRESHOLD + LOOP_BONUS * (loop depth of the call site, capped),
+or at most SINGLE_CALL_THRESHOLD if this is the only call of the callee,
+and the caller stays below MAX_CALLER_SIZE.
+Functions no longer reachable from main are removed afterwards.
+*/
 class FunctionInliner :public CFG_Pass{
 public:
 	FunctionInliner(std::shared_ptr<IR> _ir) :CFG_Pass(_ir) {}
 	bool run() override;
 private:
 
-	static const int MAX_INLINING_DEPTH = 4, INLINE_THRESHOLD = 3;
+	static const int BASE_THRESHOLD = 16, LOOP_BONUS = 40, MAX_LOOP_DEPTH = 3;
+	static const int CONST_ARG_BONUS = 3, CALL_OVERHEAD = 4;
+	static const int SINGLE_CALL_THRESHOLD = 120, MAX_CALLER_SIZE = 1500;
+
+	bool changed;
 
 	std::map<std::shared_ptr<Function>, int> call_cnt, instr_cnt;
+	// number of instructions using each formal argument (the object reference comes last)
+	std::map<std::shared_ptr<Function>, std::vector<int> > argUses;
 
 	std::map<std::shared_ptr<Operand>, std::shared_ptr<Operand> > shadowOperands;
 	std::map<std::shared_ptr<BasicBlock>, std::shared_ptr<BasicBlock> > shadowBlocks;
-	std::map<std::shared_ptr<Function>, std::shared_ptr<Function> > shadows;
-
-
 
 	void prepare();
-	void non_recursive();
-	void recursive();
+	void measure(std::shared_ptr<Function> f);
+	std::vector<std::vector<std::shared_ptr<Function> > > bottomUpComponents();
+	void inlineCallsIn(std::shared_ptr<Function> f, const std::set<std::shared_ptr<Function> > &component);
+	void removeUnreachableFunctions();
 
-	std::shared_ptr<IRInstruction> expand(std::shared_ptr<Call> c);
-	
 	bool okForInlining(std::shared_ptr<Function> f);
+	int inlineCost(std::shared_ptr<Call> c);
+	int threshold(std::shared_ptr<Call> c, int loopDepth);
 
-	bool okForRecursivelyInlining(std::shared_ptr<Function> f);
-
-	// create shadow functions for recursive functions
-	void createShadows();
-
-	std::shared_ptr<Function> createShadowFunction(std::shared_ptr<Function> f);
-
-	void setShadowOperand(std::shared_ptr<Operand> op);
-
-	void globalVarInit();
-};
\ No newline at end of file
+	void expand(std::shared_ptr<Call> c);
+	std::shared_ptr<Operand> bindArgument(std::shared_ptr<Call> c, std::shared_ptr<Operand> actual);
+};
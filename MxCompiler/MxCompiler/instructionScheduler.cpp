@@ -0,0 +1,324 @@
+#include "instructionScheduler.h"
+
+int LatencyModel::latency(std::shared_ptr<RISCVinstruction> i) const
+{
+	if (i->category() == RISCVinstruction::LOAD) return load;
+	if (i->category() == RISCVinstruction::RTYPE) {
+		auto op = std::static_pointer_cast<R_type>(i)->getOp();
+		if (op == R_type::MUL) return mul;
+		if (op == R_type::DIV || op == R_type::MOD) return div;
+	}
+	return alu;
+}
+
+void InstructionScheduler::run()
+{
+	for (auto &function : program->getFunctions()) {
+		f = function;
+		if (mode == REGISTER_PRESSURE) computeLiveness();
+		for (auto &b : f->getBlockList()) scheduleBlock(b);
+	}
+}
+
+void InstructionScheduler::computeLiveness()
+{
+	regIndex.clear();
+	liveOut.clear();
+	auto &blocks = f->getBlockList();
+	for (auto &b : blocks)
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			auto regs = i->getUseReg();
+			if (i->getDefReg() != nullptr) regs.push_back(i->getDefReg());
+			for (auto &reg : regs)
+				if (reg->category() != Operand::PHISICAL && !reg->isGlobal() && !regIndex.count(reg.get())) {
+					int index = regIndex.size();
+					regIndex[reg.get()] = index;
+				}
+		}
+
+	size_t N = regIndex.size(), n = blocks.size();
+	std::vector<BitVector> livein(n, BitVector(N)), def(n, BitVector(N)), use(n, BitVector(N));
+	for (size_t bi = 0; bi < n; bi++) {
+		liveOut[blocks[bi].get()] = BitVector(N);
+		for (auto i = blocks[bi]->getFront(); i != nullptr; i = i->getNextInstr()) {
+			for (auto &reg : i->getUseReg()) {
+				int r = indexOf(reg);
+				if (r >= 0 && !def[bi].test(r)) use[bi].set(r);
+			}
+			int d = i->getDefReg() == nullptr ? -1 : indexOf(i->getDefReg());
+			if (d >= 0) def[bi].set(d);
+		}
+	}
+
+	std::unordered_map<RISCVBasicBlock *, int> blockIndex;
+	for (size_t bi = 0; bi < n; bi++) blockIndex[blocks[bi].get()] = bi;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t k = n; k-- > 0;) {
+			auto &out = liveOut[blocks[k].get()];
+			for (auto &bb : blocks[k]->getToBlocks()) {
+				auto it = blockIndex.find(bb.get());
+				if (it != blockIndex.end()) out.unionWith(livein[it->second]);
+			}
+			BitVector in = out;
+			in.subtract(def[k]);
+			in.unionWith(use[k]);
+			if (in != livein[k]) {
+				livein[k] = std::move(in);
+				changed = true;
+			}
+		}
+	}
+}
+
+void InstructionScheduler::scheduleBlock(std::shared_ptr<RISCVBasicBlock> b)
+{
+	// the regions between the barriers, with the registers live right after each of them
+	std::vector<std::shared_ptr<RISCVinstruction> > instrs;
+	for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) instrs.push_back(i);
+	if (instrs.size() < 3) return;
+
+	size_t N = mode == REGISTER_PRESSURE ? regIndex.size() : 0;
+	BitVector live = mode == REGISTER_PRESSURE ? liveOut[b.get()] : BitVector(0);
+	std::vector<BitVector> liveAfter(instrs.size());
+	for (size_t k = instrs.size(); k-- > 0;) {
+		liveAfter[k] = live;
+		if (N == 0) continue;
+		auto def = instrs[k]->getDefReg();
+		if (def != nullptr && indexOf(def) >= 0) live.reset(indexOf(def));
+		for (auto &reg : instrs[k]->getUseReg())
+			if (indexOf(reg) >= 0) live.set(indexOf(reg));
+	}
+
+	std::vector<std::shared_ptr<RISCVinstruction> > order, region;
+	for (size_t k = 0; k < instrs.size(); k++) {
+		if (!isBarrier(instrs[k])) region.push_back(instrs[k]);
+		if (isBarrier(instrs[k]) || k + 1 == instrs.size()) {
+			if (!region.empty()) {
+				size_t last = isBarrier(instrs[k]) ? k - 1 : k;
+				auto scheduled = region.size() > 1 ? scheduleRegion(region, liveAfter[last]) : region;
+				order.insert(order.end(), scheduled.begin(), scheduled.end());
+				region.clear();
+			}
+			if (isBarrier(instrs[k])) order.push_back(instrs[k]);
+		}
+	}
+
+	for (size_t k = 0; k < order.size(); k++) {
+		order[k]->setPrevInstr(k > 0 ? order[k - 1] : nullptr);
+		order[k]->setNextInstr(k + 1 < order.size() ? order[k + 1] : nullptr);
+	}
+	b->setFront(order.front());
+	b->setBack(order.back());
+}
+
+std::vector<std::shared_ptr<RISCVinstruction> > InstructionScheduler::scheduleRegion(
+	const std::vector<std::shared_ptr<RISCVinstruction> > &region, const BitVector &liveAfter)
+{
+	buildDAG(region);
+	int n = nodes.size();
+
+	// the uses left of every virtual register, to tell when a live range ends
+	std::unordered_map<int, int> usesLeft;
+	BitVector live(liveAfter.size());
+	int pressure = 0, limit = (int)RISCVConfig::allocatableRegNames.size() - PRESSURE_MARGIN;
+	if (mode == REGISTER_PRESSURE) {
+		for (auto &node : nodes)
+			for (auto &reg : node.instr->getUseReg())
+				if (indexOf(reg) >= 0) usesLeft[indexOf(reg)]++;
+		// live at the start: live after the region, or read in it before being written
+		live = liveAfter;
+		for (int k = n; k-- > 0;) {
+			auto def = nodes[k].instr->getDefReg();
+			if (def != nullptr && indexOf(def) >= 0) live.reset(indexOf(def));
+			for (auto &reg : nodes[k].instr->getUseReg())
+				if (indexOf(reg) >= 0) live.set(indexOf(reg));
+		}
+		live.forEach([&](size_t) { pressure++; });
+	}
+	// the change of the number of live registers if <k> is issued now
+	auto delta = [&](int k) {
+		int d = 0;
+		std::set<int> seen;
+		for (auto &reg : nodes[k].instr->getUseReg()) {
+			int r = indexOf(reg);
+			if (r >= 0 && seen.insert(r).second && live.test(r) && !liveAfter.test(r)) {
+				int uses = 0;
+				for (auto &other : nodes[k].instr->getUseReg()) if (other == reg) uses++;
+				if (usesLeft[r] == uses) d--;
+			}
+		}
+		auto def = nodes[k].instr->getDefReg();
+		if (def != nullptr && indexOf(def) >= 0 && !live.test(indexOf(def))) d++;
+		return d;
+	};
+
+	std::vector<int> ready;
+	for (int k = 0; k < n; k++)
+		if (nodes[k].preds == 0) ready.push_back(k);
+	std::vector<std::shared_ptr<RISCVinstruction> > order;
+	int cycle = 0;
+	while (!ready.empty()) {
+		// prefer the instructions that can issue now, then the longest path to the end
+		auto better = [&](int x, int y) {
+			if (mode == REGISTER_PRESSURE && pressure >= limit) {
+				int dx = delta(x), dy = delta(y);
+				if (dx != dy) return dx < dy;
+			}
+			bool rx = nodes[x].earliest <= cycle, ry = nodes[y].earliest <= cycle;
+			if (rx != ry) return rx;
+			if (!rx && nodes[x].earliest != nodes[y].earliest) return nodes[x].earliest < nodes[y].earliest;
+			if (nodes[x].height != nodes[y].height) return nodes[x].height > nodes[y].height;
+			return x < y;
+		};
+		size_t best = 0;
+		for (size_t k = 1; k < ready.size(); k++)
+			if (better(ready[k], ready[best])) best = k;
+		int k = ready[best];
+		ready.erase(ready.begin() + best);
+
+		if (mode == REGISTER_PRESSURE) {
+			pressure += delta(k);
+			for (auto &reg : nodes[k].instr->getUseReg()) {
+				int r = indexOf(reg);
+				if (r >= 0 && --usesLeft[r] == 0 && !liveAfter.test(r)) live.reset(r);
+			}
+			auto def = nodes[k].instr->getDefReg();
+			if (def != nullptr && indexOf(def) >= 0) live.set(indexOf(def));
+		}
+
+		cycle = std::max(cycle, nodes[k].earliest);
+		order.push_back(nodes[k].instr);
+		for (auto &e : nodes[k].succ) {
+			nodes[e.first].earliest = std::max(nodes[e.first].earliest, cycle + e.second);
+			if (--nodes[e.first].preds == 0) ready.push_back(e.first);
+		}
+		cycle++;
+	}
+	if ((int)order.size() != n)
+		throw Error("cyclic dependences in a basic block");
+	return order;
+}
+
+void InstructionScheduler::buildDAG(const std::vector<std::shared_ptr<RISCVinstruction> > &region)
+{
+	int n = region.size();
+	nodes.assign(n, Node());
+	for (int k = 0; k < n; k++) {
+		nodes[k].instr = region[k];
+		nodes[k].preds = nodes[k].earliest = 0;
+	}
+	std::set<std::pair<int, int> > edges;
+	auto addEdge = [&](int from, int to, int latency) {
+		if (from == to) return;
+		if (!edges.insert({ from, to }).second) {
+			for (auto &e : nodes[from].succ)
+				if (e.first == to) e.second = std::max(e.second, latency);
+			return;
+		}
+		nodes[from].succ.push_back({ to, latency });
+		nodes[to].preds++;
+	};
+
+	// the last write of every register, and the reads since then
+	std::map<Register *, int> lastDef;
+	std::map<Register *, std::vector<int> > readers;
+	// a heap address is its base register, in the version of its last write, and the offset
+	std::map<Register *, int> version;
+	struct Access {
+		int node, size, version;
+		bool store;
+		std::shared_ptr<Address> addr;
+	};
+	std::vector<Access> accesses;
+	auto mayAlias = [&](const Access &x, const Access &y) {
+		auto cx = x.addr->category(), cy = y.addr->category();
+		if (cx != cy) return false;  // the frame and the heap are apart
+		int ox = x.addr->getOffset(), oy = y.addr->getOffset();
+		if (cx == Operand::STACK) {
+			auto sx = std::static_pointer_cast<StackLocation>(x.addr), sy = std::static_pointer_cast<StackLocation>(y.addr);
+			if (sx->isTopDown() != sy->isTopDown()) {
+				// the size of the frame is only known after the frame is laid out
+				if (mode == REGISTER_PRESSURE) return true;
+				int size = f->getStackSize();
+				if (!sx->isTopDown()) ox = size - ox;
+				if (!sy->isTopDown()) oy = size - oy;
+			}
+		}
+		else {
+			auto bx = std::static_pointer_cast<BaseOffsetAddr>(x.addr)->getBase();
+			auto by = std::static_pointer_cast<BaseOffsetAddr>(y.addr)->getBase();
+			if (bx->isGlobal() || by->isGlobal()) return bx == by;
+			if (bx != by || x.version != y.version) return true;
+		}
+		return ox < oy + y.size && oy < ox + x.size;
+	};
+
+	for (int k = 0; k < n; k++) {
+		auto i = region[k];
+		for (auto &reg : i->getUseReg()) {
+			auto it = lastDef.find(reg.get());
+			if (it != lastDef.end()) addEdge(it->second, k, model.latency(region[it->second]));
+			readers[reg.get()].push_back(k);
+		}
+		auto def = i->getDefReg();
+		if (def != nullptr) {
+			for (auto r : readers[def.get()]) addEdge(r, k, 0);
+			auto it = lastDef.find(def.get());
+			if (it != lastDef.end()) addEdge(it->second, k, 1);
+			readers[def.get()].clear();
+			lastDef[def.get()] = k;
+			version[def.get()]++;
+		}
+
+		int size = 0;
+		auto addr = memoryAccess(i, size);
+		if (addr == nullptr) continue;
+		Access access = { k, size, 0, i->category() == RISCVinstruction::STORE, addr };
+		if (addr->category() == Operand::ADDR)
+			access.version = version[std::static_pointer_cast<BaseOffsetAddr>(addr)->getBase().get()];
+		for (auto &other : accesses)
+			if ((access.store || other.store) && mayAlias(other, access))
+				addEdge(other.node, k, other.store ? 1 : 0);
+		accesses.push_back(access);
+	}
+
+	// the longest latency path from every node to the end of the region
+	for (int k = n; k-- > 0;) {
+		nodes[k].height = model.latency(region[k]);
+		for (auto &e : nodes[k].succ)
+			nodes[k].height = std::max(nodes[k].height, e.second + nodes[e.first].height);
+	}
+}
+
+bool InstructionScheduler::isBarrier(std::shared_ptr<RISCVinstruction> i)
+{
+	auto c = i->category();
+	if (c == RISCVinstruction::CALL || c == RISCVinstruction::RET
+		|| c == RISCVinstruction::JUMP || c == RISCVinstruction::BTYPE)
+		return true;
+	// before allocation the arguments, the return value and the restored registers are
+	// written right before the call or ret that reads them, which the allocator relies on
+	auto def = i->getDefReg();
+	return mode == REGISTER_PRESSURE && def != nullptr && def->category() == Operand::PHISICAL;
+}
+
+int InstructionScheduler::indexOf(std::shared_ptr<Register> reg)
+{
+	auto it = regIndex.find(reg.get());
+	return it == regIndex.end() ? -1 : it->second;
+}
+
+std::shared_ptr<Address> InstructionScheduler::memoryAccess(std::shared_ptr<RISCVinstruction> i, int &size)
+{
+	if (i->category() == RISCVinstruction::LOAD) {
+		size = std::static_pointer_cast<Load>(i)->getSize();
+		return std::static_pointer_cast<Load>(i)->getAddr();
+	}
+	if (i->category() == RISCVinstruction::STORE) {
+		size = std::static_pointer_cast<Store>(i)->getSize();
+		return std::static_pointer_cast<Store>(i)->getAddr();
+	}
+	return nullptr;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pch.h"
+#include "RISCVassembly.h"
+#include "BitVector.h"
+#include <unordered_map>
+
+/*
+Struct: LatencyModel
+The number of cycles after which the result of an instruction can be used.
+The default is a single-issue in-order RV32IM pipeline: loads have a load-use
+delay, multiplication is pipelined and division is not.
+*/
+struct LatencyModel {
+	int alu, load, mul, div;
+
+	int latency(std::shared_ptr<RISCVinstruction> i) const;
+
+	static LatencyModel inOrderRV32IM() { return { 1, 3, 3, 20 }; }
+};
+
+/*
+Class: InstructionScheduler
+List scheduling inside basic blocks, c.f. MxCompiler::O3.
+A block is cut into regions at calls and at the branches and jumps that end it
+(and, before allocation, at the writes of physical registers).
+Every region gets a dependency DAG: register dependences from getUseReg/getDefReg
+(true ones weighted by the latency of the producer) and the order of loads and
+stores that may touch the same memory. Ready instructions are issued one per
+cycle, the one with the longest latency path to the end of the region first.
+- REGISTER_PRESSURE runs before register allocation: once the live virtual
+  registers come close to the allocatable ones, it prefers the instructions that
+  end the most live ranges over the critical path.
+- LATENCY runs after allocation and the frame layout, and only hides latency.
+*/
+class InstructionScheduler {
+public:
+	enum Mode { REGISTER_PRESSURE, LATENCY };
+
+	InstructionScheduler(std::shared_ptr<RISCVProgram> _program, Mode _mode,
+		const LatencyModel &_model = LatencyModel::inOrderRV32IM())
+		:program(_program), mode(_mode), model(_model) {}
+
+	void run();
+
+private:
+	// registers kept free for the values that only live across a region
+	static const int PRESSURE_MARGIN = 4;
+
+	struct Node {
+		std::shared_ptr<RISCVinstruction> instr;
+		std::vector<std::pair<int, int> > succ;  // (node, latency)
+		int preds, height, earliest;
+	};
+
+	std::shared_ptr<RISCVProgram> program;
+	Mode mode;
+	LatencyModel model;
+	std::shared_ptr<RISCVFunction> f;
+
+	// the virtual registers and their liveness at the end of every block (REGISTER_PRESSURE)
+	std::unordered_map<Register *, int> regIndex;
+	std::unordered_map<RISCVBasicBlock *, BitVector> liveOut;
+
+	std::vector<Node> nodes;
+
+	void computeLiveness();
+	void scheduleBlock(std::shared_ptr<RISCVBasicBlock> b);
+	// the new order of <region>, given the virtual registers live right after it
+	std::vector<std::shared_ptr<RISCVinstruction> > scheduleRegion(
+		const std::vector<std::shared_ptr<RISCVinstruction> > &region, const BitVector &liveAfter);
+	void buildDAG(const std::vector<std::shared_ptr<RISCVinstruction> > &region);
+
+	bool isBarrier(std::shared_ptr<RISCVinstruction> i);
+	// the index of a virtual register, -1 for physical and global ones
+	int indexOf(std::shared_ptr<Register> reg);
+	std::shared_ptr<Address> memoryAccess(std::shared_ptr<RISCVinstruction> i, int &size);
+};
@@ -2,9 +2,13 @@
 
 void IR_Interpreter::run()
 {
-	parse();
+	if (ir != nullptr) lowerIR();
+	else {
+		parse();
+		if (mode == BYTECODE) lower();
+	}
 	os << "---------------------------------Execution--------------------------" << std::endl;
-	int exitCode = executeFunction("__bootstrap");
+	int exitCode = mode == BYTECODE ? executeBytecode() : executeFunction("__bootstrap");
 	os << "\nexit with " << exitCode << std::endl;
 }
 
@@ -29,24 +33,43 @@ void IR_Interpreter::setRegVal(const std::string & name, std::map<std::string, i
 	M.setRegValue(name, v);
 }
 
+// static strings keep the escape sequences of the source text
+static std::string unescape(const std::string &str)
+{
+	std::string ret;
+	for (int i = 0; i < str.length(); i++) {
+		if (str[i] != '\\' || i + 1 == str.length()) {
+			ret += str[i];
+			continue;
+		}
+		switch (str[++i])
+		{
+		case 'n': ret += '\n';
+			break;
+		case 't': ret += '\t';
+			break;
+		default: ret += str[i];  // \\ and \"
+			break;
+		}
+	}
+	return ret;
+}
+
 void IR_Interpreter::parse()
 {
 	std::string token;
-	while (is >> token) {
+	while (*is >> token) {
 		if (token[0] == '@') {
 			if (nextchar() == '=') {
 				// string constants
-				is.get();  // skip '='
+				is->get();  // skip '='
 				std::string str, reg = token;
-				std::getline(is,str);
-				str = str.substr(2, str.length() - 3); // skip space and ""
-				auto ptr = M.allocate_memory(str.length() + Configuration::SIZE_OF_INT);
-				*reinterpret_cast<int *>(ptr) = str.length();
-				std::memcpy(ptr + Configuration::SIZE_OF_INT, str.c_str(), str.length());
-				M.setRegValue(reg, reinterpret_cast<int>(ptr));
+				std::getline(*is,str);
+				str = unescape(str.substr(2, str.length() - 3)); // skip space and ""
+				M.setRegValue(reg, storeString(str));
 			}
 			else { // global variables 
-				M.setRegValue(token, (int)M.allocate_memory(Configuration::SIZE_OF_PTR));
+				M.setRegValue(token, M.allocate_memory(Configuration::SIZE_OF_PTR));
 			}
 		}
 		else if (token == "def") parseFunction();
@@ -57,16 +80,16 @@ void IR_Interpreter::parse()
 void IR_Interpreter::parseFunction()
 {
 	std::string name;
-	is >> name;
+	*is >> name;
 	name = name.substr(1, name.length() - 1);
 	std::vector<std::string> args;
 
 	while (nextchar() != '{') {
 		std::string arg;
-		is >> arg;
+		*is >> arg;
 		args.push_back(arg);
 	}
-	is.get();  // skip '{'
+	is->get();  // skip '{'
 	auto f = std::make_shared<VMFunction>(name, args);
 	
 	while (nextchar() != '}') {
@@ -75,7 +98,7 @@ void IR_Interpreter::parseFunction()
 		if (b->isEntry()) f->setEntry(b);
 		auto ch = nextchar();
 	}
-	is.get(); // skip '}'
+	is->get(); // skip '}'
 
 	functions[name] = f;
 }
@@ -83,7 +106,7 @@ void IR_Interpreter::parseFunction()
 std::shared_ptr<VMBasicBlock> IR_Interpreter::parseBlock()
 {
 	std::string label;
-	is >> label;
+	*is >> label;
 	if (label[0] != '$') throw Error("invalid block");
 	label = label.substr(1, label.length() - 2);
 	auto b = std::make_shared<VMBasicBlock>(label);
@@ -101,50 +124,50 @@ std::shared_ptr<VMInstruction> IR_Interpreter::parseInstruction()
 {
 	std::string op, dst, src1, src2;
 
-	is >> op;
+	*is >> op;
 	if (op == "call") {
 		std::vector<std::string> args;
 		std::string arg;
-		is >> src1  >> dst;  
+		*is >> src1  >> dst;  
 
 		while (true) {
 			char ch = nextchar();
 			if (ch != '%' && ch != '@' && ch != '#') break;
-			is >> arg;
+			*is >> arg;
 			args.push_back(arg);
 		}
 		return std::make_shared<VMInstruction>(op, dst, src1,"", args);
 	}
 	if (op == "jmp") {
-		is >> dst;
+		*is >> dst;
 		return std::make_shared<VMInstruction>(op, dst);
 	}
 	else if (op == "ret") {
 		char ch = nextchar();
 		if (ch != '%' && ch != '@' && ch != '#') return std::make_shared<VMInstruction>(op, "");
 		else {
-			is >> dst;
+			*is >> dst;
 			return std::make_shared<VMInstruction>(op, dst);
 		}
 	}
 	else if(op == "inv" || op == "neg" || op == "mov" || op == "load" || op == "store" || op == "malloc") {
-		is >> dst >> src1;
+		*is >> dst >> src1;
 		return std::make_shared<VMInstruction>(op, dst, src1);
 	}
 	else if (op == "phi") {
-		is >> dst;
+		*is >> dst;
 		int n;
-		is >> n;
+		*is >> n;
 		std::vector<std::string> args;
 		while (n--) {
-			is >> src1 >> src2;
+			*is >> src1 >> src2;
 			args.push_back(src1);
 			args.push_back(src2);
 		}
 		return std::make_shared<VMInstruction>(op, dst, "", "", args);
 	}
 	else {
-		is >> dst >> src1 >> src2;
+		*is >> dst >> src1 >> src2;
 		return std::make_shared<VMInstruction>(op, dst, src1, src2);
 	}
 }
@@ -243,7 +266,7 @@ void IR_Interpreter::executeInstruction(std::shared_ptr<VMInstruction> inst, std
 		M.store(getRegVal(inst->dst, localRegs), getRegVal(inst->src1, localRegs));
 	else if (inst->op == "malloc")
 		setRegVal(inst->dst, localRegs,
-		(int)M.allocate_memory(getRegVal(inst->src1, localRegs)));
+		M.allocate_memory(getRegVal(inst->src1, localRegs)));
 	else if (inst->op == "call") {
 		std::vector<int> argv;
 		for (auto &reg : inst->args) argv.push_back(getRegVal(reg, localRegs));
@@ -285,12 +308,12 @@ int IR_Interpreter::string_length(Args args)
 
 int IR_Interpreter::string_ord(Args args)
 {
-	return M.loadByte(args[0] + Configuration::SIZE_OF_INT);
+	return M.loadByte(args[0] + Configuration::SIZE_OF_INT + args[1]);
 }
 
 int IR_Interpreter::string_substring(Args args)
 {
-	auto str = fetchString(args[0]).substr(args[1], args[2] - args[1] + 1);
+	auto str = fetchString(args[0]).substr(args[1], args[2] - args[1]);
 	return storeString(str);
 }
 
@@ -303,18 +326,10 @@ int IR_Interpreter::getString(Args args)
 
 int IR_Interpreter::string_parseInt(Args args)
 {
-	std::string str = fetchString(args[0]);
-	std::vector<int> V;
-	std::stringstream ss(str);
-	int x;
-	while (ss >> x) V.push_back(x);
-	Byte *ptr = M.allocate_memory((V.size() + 1) * Configuration::SIZE_OF_INT);
-	M.store((int)ptr, V.size());
-	for (Byte *cur = ptr + Configuration::SIZE_OF_INT, i = 0; i < V.size(); i++) {
-		M.store((int)cur, V[i]);
-		cur += Configuration::SIZE_OF_INT;
-	}
-	return (int)ptr;
+	std::stringstream ss(fetchString(args[0]));
+	int x = 0;
+	ss >> x;
+	return x;
 }
 
 int IR_Interpreter::string_add(Args args)
@@ -379,19 +394,504 @@ int IR_Interpreter::toString(Args args)
 std::string IR_Interpreter::fetchString(int addr)
 {
 	int l = M.load(addr);  // length
-	auto ptr = reinterpret_cast<char *>(addr) + Configuration::SIZE_OF_INT;
-	char *str = new char[l + 1];
-	std::memcpy(str, ptr, l);
-	str[l] = '\0';
-	auto ret =  std::string(str);
-	delete[] str;
-	return ret;
+	return std::string(M.translate(addr + Configuration::SIZE_OF_INT, l), l);
 }
 
 int IR_Interpreter::storeString(std::string str)
 {
-	Byte *ptr = M.allocate_memory(str.length() + Configuration::SIZE_OF_INT);
-	M.store((int)ptr, str.length());
-	std::memcpy(ptr + Configuration::SIZE_OF_INT, str.c_str(), str.length());
-	return (int)ptr;
+	int addr = M.allocate_memory(str.length() + Configuration::SIZE_OF_INT);
+	M.store(addr, str.length());
+	std::memcpy(M.translate(addr + Configuration::SIZE_OF_INT, str.length()), str.c_str(), str.length());
+	return addr;
+}
+
+/*************************Bytecode engine**************************/
+
+void IR_Interpreter::lower()
+{
+	program = BCProgram();
+	builtins.clear();
+	builtinIndex.clear();
+	functionIndex.clear();
+
+	for (auto &it : functions) {
+		functionIndex[it.first] = program.functions.size();
+		program.functions.push_back(std::make_shared<BCFunction>(it.first));
+	}
+	auto entry = functionIndex.find("__bootstrap");
+	if (entry == functionIndex.end()) throw Error("bytecode: no __bootstrap function");
+	program.entry = entry->second;
+
+	for (auto &it : functions) lowerFunction(it.second, program.functions[functionIndex[it.first]]);
+}
+
+void IR_Interpreter::lowerFunction(std::shared_ptr<VMFunction> vf, std::shared_ptr<BCFunction> f)
+{
+	std::map<std::string, int> slots;
+	for (auto &arg : vf->getArgs()) slots[arg] = f->newLocal();
+	f->numArgs = vf->getArgs().size();
+
+	// the entry block goes first, so that execution starts at pc 0
+	std::vector<std::shared_ptr<VMBasicBlock> > blocks = { vf->getEntry() };
+	for (auto &it : vf->getBlocks())
+		if (it.second != vf->getEntry()) blocks.push_back(it.second);
+
+	auto isTerminator = [](const std::string &op) { return op == "jmp" || op == "br" || op == "ret"; };
+
+	// 1. compute the pc of each block (all phi-functions of a block collapse into one instruction)
+	std::map<std::string, int> blockId, blockPc;
+	int pc = 0;
+	for (auto &b : blocks) {
+		int id = blockId.size();
+		blockId[b->getLabel()] = id;
+		blockPc[b->getLabel()] = pc;
+		bool hasPhi = false, ended = false;
+		for (auto &inst : b->getInstructions()) {
+			if (inst->op == "phi") hasPhi = true;
+			else pc++;
+			if (isTerminator(inst->op)) {
+				ended = true;
+				break;
+			}
+		}
+		if (!ended) throw Error("bytecode: block " + b->getLabel() + " is not terminated");
+		if (hasPhi) pc++;
+	}
+	auto target = [&](const std::string &label) {
+		auto it = blockPc.find(label);
+		if (it == blockPc.end()) throw Error("bytecode: undefined block " + label);
+		return it->second;
+	};
+
+	static const std::map<std::string, BCInstruction::Opcode> binaryOps = {
+		{"add", BCInstruction::ADD}, {"sub", BCInstruction::SUB}, {"mul", BCInstruction::MUL},
+		{"div", BCInstruction::DIV}, {"mod", BCInstruction::MOD},
+		{"shl", BCInstruction::SHL}, {"shr", BCInstruction::SHR},
+		{"seq", BCInstruction::SEQ}, {"sne", BCInstruction::SNE},
+		{"slt", BCInstruction::SLT}, {"sle", BCInstruction::SLE},
+		{"sgt", BCInstruction::SGT}, {"sge", BCInstruction::SGE},
+		{"and", BCInstruction::AND}, {"or", BCInstruction::OR}, {"xor", BCInstruction::XOR},
+	};
+	static const std::map<std::string, BCInstruction::Opcode> unaryOps = {
+		{"inv", BCInstruction::INV}, {"neg", BCInstruction::NEG}, {"mov", BCInstruction::MOV},
+		{"load", BCInstruction::LOAD}, {"store", BCInstruction::STORE}, {"malloc", BCInstruction::MALLOC}
+	};
+
+	// 2. emit instructions
+	for (auto &b : blocks) {
+		int id = blockId[b->getLabel()];
+		auto &instructions = b->getInstructions();
+		int k = 0;
+		if (!instructions.empty() && instructions[0]->op == "phi") {
+			BCPhiGroup group;
+			std::map<int, int> optionOf;  // predecessor -> index in group.options
+			for (; instructions[k]->op == "phi"; k++) {
+				auto &V = instructions[k]->args;
+				for (int j = 0; j < V.size(); j += 2) {
+					int from = blockId.at(V[j + 1]);
+					if (optionOf.find(from) == optionOf.end()) {
+						optionOf[from] = group.options.size();
+						group.options.emplace_back(from, std::vector<int>(group.dsts.size(), -1));
+					}
+				}
+				group.dsts.push_back(lowerOperand(instructions[k]->dst, slots, f));
+				for (auto &option : group.options) option.second.push_back(-1);
+				for (int j = 0; j < V.size(); j += 2)
+					group.options[optionOf[blockId.at(V[j + 1])]].second.back() = lowerOperand(V[j], slots, f);
+			}
+			// an undefined option reads zero, as the string dispatcher does
+			for (auto &option : group.options)
+				for (auto &slot : option.second)
+					if (slot == -1) slot = f->newConstant(0);
+			f->code.emplace_back(BCInstruction::PHI, -1, -1, -1, f->phiGroups.size());
+			f->phiGroups.push_back(group);
+		}
+
+		for (; k < instructions.size(); k++) {
+			auto &inst = instructions[k];
+			auto &op = inst->op;
+			if (op == "jmp")
+				f->code.emplace_back(BCInstruction::JMP, -1, target(inst->dst), -1, id);
+			else if (op == "br")
+				f->code.emplace_back(BCInstruction::BR, lowerOperand(inst->dst, slots, f),
+					target(inst->src1), target(inst->src2), id);
+			else if (op == "ret") {
+				if (inst->dst == "") f->code.emplace_back(BCInstruction::RET_VOID);
+				else f->code.emplace_back(BCInstruction::RET, lowerOperand(inst->dst, slots, f));
+			}
+			else if (op == "call") {
+				bool isBuiltin;
+				int callee = resolveCallee(inst->dst, isBuiltin);
+				int result = inst->src1 == "null" ? -1 : lowerOperand(inst->src1, slots, f);
+				int offset = f->argSlots.size();
+				for (auto &arg : inst->args) f->argSlots.push_back(lowerOperand(arg, slots, f));
+				f->code.emplace_back(isBuiltin ? BCInstruction::CALL_BUILTIN : BCInstruction::CALL,
+					result, callee, (int)inst->args.size(), offset);
+			}
+			else if (op == "phi") throw Error("bytecode: phi-function after ordinary instructions");
+			else if (unaryOps.find(op) != unaryOps.end())
+				f->code.emplace_back(unaryOps.at(op), lowerOperand(inst->dst, slots, f), lowerOperand(inst->src1, slots, f));
+			else if (binaryOps.find(op) != binaryOps.end())
+				f->code.emplace_back(binaryOps.at(op), lowerOperand(inst->dst, slots, f),
+					lowerOperand(inst->src1, slots, f), lowerOperand(inst->src2, slots, f));
+			else throw Error("bytecode: unknown instruction " + op);
+
+			if (isTerminator(op)) break;
+		}
+	}
+	f->seal();
+}
+
+int IR_Interpreter::lowerOperand(const std::string & name, std::map<std::string, int>& slots, 
+	std::shared_ptr<BCFunction> f)
+{
+	if (name[0] == '#') return f->newConstant(std::stoi(name.substr(1)));
+	if (name[0] == '@') return f->newConstant(M.getRegValue(name));  // address of global or static string
+	auto it = slots.find(name);
+	if (it != slots.end()) return it->second;
+	return slots[name] = f->newLocal();
+}
+
+int IR_Interpreter::resolveCallee(const std::string & name, bool & isBuiltin)
+{
+	auto it = functionIndex.find(name);
+	if (it != functionIndex.end()) {
+		isBuiltin = false;
+		return it->second;
+	}
+	isBuiltin = true;
+	auto b = builtinIndex.find(name);
+	if (b != builtinIndex.end()) return b->second;
+	auto func = name2Func.find(name);
+	if (func == name2Func.end()) throw Error("bytecode: undefined function " + name);
+	builtins.push_back(func->second);
+	return builtinIndex[name] = builtins.size() - 1;
+}
+
+void IR_Interpreter::lowerIR()
+{
+	program = BCProgram();
+	builtins.clear();
+	builtinIndex.clear();
+	functionIndex.clear();
+	globalAddr.clear();
+
+	for (auto &var : ir->getGlbVars())
+		globalAddr[var.get()] = M.allocate_memory(Configuration::SIZE_OF_PTR);
+	for (auto &str : ir->getStringConstants())
+		globalAddr[str->getReg().get()] = storeString(unescape(str->getText()));
+
+	auto &functions = ir->getFunctions();
+	for (auto &f : functions) {
+		functionIndex[f->getName()] = program.functions.size();
+		program.functions.push_back(std::make_shared<BCFunction>(f->getName()));
+	}
+	auto entry = functionIndex.find("__bootstrap");
+	if (entry == functionIndex.end()) throw Error("bytecode: no __bootstrap function");
+	program.entry = entry->second;
+
+	for (int i = 0; i < functions.size(); i++) lowerFunction(functions[i], program.functions[i]);
+}
+
+void IR_Interpreter::lowerFunction(std::shared_ptr<Function> irf, std::shared_ptr<BCFunction> f)
+{
+	std::map<Register *, int> slots;
+	auto args = irf->getArgs();
+	if (irf->getObjRef() != nullptr)
+		args.insert(args.begin(), std::static_pointer_cast<Register>(irf->getObjRef()));
+	for (auto &arg : args) slots[arg.get()] = f->newLocal();
+	f->numArgs = args.size();
+
+	std::vector<std::shared_ptr<BasicBlock> > blocks = { irf->getEntry() };
+	for (auto &b : irf->getBlockList())
+		if (b != irf->getEntry()) blocks.push_back(b);
+
+	auto isTerminator = [](IRInstruction::InstrTag tag) {
+		return tag == IRInstruction::JUMP || tag == IRInstruction::BRANCH || tag == IRInstruction::RET;
+	};
+
+	// 1. compute the pc of each block, as lowerFunction(VMFunction) does
+	std::map<BasicBlock *, int> blockId, blockPc;
+	int pc = 0;
+	for (auto &b : blocks) {
+		int id = blockId.size();
+		blockId[b.get()] = id;
+		blockPc[b.get()] = pc;
+		bool hasPhi = false, ended = false;
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			if (i->getTag() == IRInstruction::PHI) hasPhi = true;
+			else pc++;
+			if (isTerminator(i->getTag())) {
+				ended = true;
+				break;
+			}
+		}
+		if (!ended) throw Error("bytecode: block " + b->toString() + " is not terminated");
+		if (hasPhi) pc++;
+	}
+	auto target = [&](std::shared_ptr<BasicBlock> b) {
+		auto it = blockPc.find(b.get());
+		if (it == blockPc.end()) throw Error("bytecode: jump to a block out of " + irf->getName());
+		return it->second;
+	};
+
+	// must be kept in the same order as Quadruple::Operator
+	static const BCInstruction::Opcode opcodes[] = {
+		BCInstruction::ADD, BCInstruction::SUB, BCInstruction::MUL, BCInstruction::DIV, BCInstruction::MOD,
+		BCInstruction::SLT, BCInstruction::SLE, BCInstruction::SGT, BCInstruction::SGE,
+		BCInstruction::SNE, BCInstruction::SEQ,
+		BCInstruction::SHL, BCInstruction::SHR,
+		BCInstruction::AND, BCInstruction::OR, BCInstruction::XOR,
+		BCInstruction::NEG, BCInstruction::INV, BCInstruction::MOV,
+		BCInstruction::LOAD, BCInstruction::STORE
+	};
+
+	// 2. emit instructions
+	for (auto &b : blocks) {
+		int id = blockId[b.get()];
+		auto i = b->getFront();
+		if (i != nullptr && i->getTag() == IRInstruction::PHI) {
+			BCPhiGroup group;
+			std::map<int, int> optionOf;  // predecessor -> index in group.options
+			for (; i != nullptr && i->getTag() == IRInstruction::PHI; i = i->getNextInstr()) {
+				auto phi = std::static_pointer_cast<PhiFunction>(i);
+				auto &options = phi->getRelatedRegs();
+				for (auto &opt : options) {
+					auto from = blockId.find(opt.second.lock().get());
+					if (from == blockId.end()) continue;  // the edge has been removed
+					if (optionOf.find(from->second) == optionOf.end()) {
+						optionOf[from->second] = group.options.size();
+						group.options.emplace_back(from->second, std::vector<int>(group.dsts.size(), -1));
+					}
+				}
+				group.dsts.push_back(lowerOperand(phi->getDst(), slots, f));
+				for (auto &option : group.options) option.second.push_back(-1);
+				for (auto &opt : options) {
+					auto from = blockId.find(opt.second.lock().get());
+					if (from == blockId.end()) continue;
+					group.options[optionOf[from->second]].second.back() = lowerOperand(opt.first, slots, f);
+				}
+			}
+			for (auto &option : group.options)
+				for (auto &slot : option.second)
+					if (slot == -1) slot = f->newConstant(0);
+			f->code.emplace_back(BCInstruction::PHI, -1, -1, -1, f->phiGroups.size());
+			f->phiGroups.push_back(group);
+		}
+
+		for (; i != nullptr; i = i->getNextInstr()) {
+			auto tag = i->getTag();
+			if (tag == IRInstruction::QUADR) {
+				auto q = std::static_pointer_cast<Quadruple>(i);
+				f->code.emplace_back(opcodes[q->getOp()], lowerOperand(q->getDst(), slots, f),
+					lowerOperand(q->getSrc1(), slots, f),
+					q->getSrc2() == nullptr ? -1 : lowerOperand(q->getSrc2(), slots, f));
+			}
+			else if (tag == IRInstruction::JUMP)
+				f->code.emplace_back(BCInstruction::JMP, -1,
+					target(std::static_pointer_cast<Jump>(i)->getTarget()), -1, id);
+			else if (tag == IRInstruction::BRANCH) {
+				auto br = std::static_pointer_cast<Branch>(i);
+				f->code.emplace_back(BCInstruction::BR, lowerOperand(br->getCondition(), slots, f),
+					target(br->getTrueBlock()), target(br->getFalseBlock()), id);
+			}
+			else if (tag == IRInstruction::RET) {
+				auto value = std::static_pointer_cast<Return>(i)->getValue();
+				if (value == nullptr) f->code.emplace_back(BCInstruction::RET_VOID);
+				else f->code.emplace_back(BCInstruction::RET, lowerOperand(value, slots, f));
+			}
+			else if (tag == IRInstruction::CALL) {
+				auto c = std::static_pointer_cast<Call>(i);
+				bool isBuiltin;
+				int callee = resolveCallee(c->getFunction()->getName(), isBuiltin);
+				int result = c->getResult() == nullptr ? -1 : lowerOperand(c->getResult(), slots, f);
+				int offset = f->argSlots.size();
+				if (c->getObjRef() != nullptr) f->argSlots.push_back(lowerOperand(c->getObjRef(), slots, f));
+				for (auto &arg : c->getArgs()) f->argSlots.push_back(lowerOperand(arg, slots, f));
+				f->code.emplace_back(isBuiltin ? BCInstruction::CALL_BUILTIN : BCInstruction::CALL,
+					result, callee, (int)f->argSlots.size() - offset, offset);
+			}
+			else if (tag == IRInstruction::ALLOC) {
+				auto m = std::static_pointer_cast<Malloc>(i);
+				f->code.emplace_back(BCInstruction::MALLOC, lowerOperand(m->getPtr(), slots, f),
+					lowerOperand(m->getSize(), slots, f));
+			}
+			else if (tag == IRInstruction::PHI) throw Error("bytecode: phi-function after ordinary instructions");
+			else throw Error("bytecode: unknown instruction in " + irf->getName());
+
+			if (isTerminator(tag)) break;
+		}
+	}
+	f->seal();
+}
+
+int IR_Interpreter::lowerOperand(std::shared_ptr<Operand> op, std::map<Register*, int>& slots, 
+	std::shared_ptr<BCFunction> f)
+{
+	if (op == nullptr) return f->newConstant(0);  // undefined phi option
+	auto c = op->category();
+	if (c == Operand::IMM) return f->newConstant(std::static_pointer_cast<Immediate>(op)->getValue());
+	if (c == Operand::STATICSTR) op = std::static_pointer_cast<StaticString>(op)->getReg();
+
+	auto reg = std::static_pointer_cast<Register>(op).get();
+	if (reg->isGlobal()) {
+		auto it = globalAddr.find(reg);
+		if (it == globalAddr.end()) throw Error("bytecode: undefined global " + reg->getName());
+		return f->newConstant(it->second);
+	}
+	auto it = slots.find(reg);
+	if (it != slots.end()) return it->second;
+	return slots[reg] = f->newLocal();
+}
+
+// The arithmetic follows RV32IM, which is what the generated code runs on
+static inline int bcDiv(int x, int y)
+{
+	if (y == 0) return -1;
+	if (y == -1) return (int)(0u - (unsigned)x);
+	return x / y;
+}
+
+static inline int bcRem(int x, int y)
+{
+	if (y == 0) return x;
+	if (y == -1) return 0;
+	return x % y;
+}
+
+#if defined(__GNUC__)
+#define BC_THREADED_DISPATCH   // use computed goto, otherwise fall back to a switch
+#endif
+
+int IR_Interpreter::executeBytecode()
+{
+	struct Frame {
+		BCFunction *f;
+		const BCInstruction *ret;
+		int base, dst;
+	};
+	std::vector<Frame> frames;
+	std::vector<int> stack(1 << 16), argv;
+
+	BCFunction *f = program.functions[program.entry].get();
+	int base = 0, from = -1;
+	if (f->frameSize() > stack.size()) stack.resize(f->frameSize());
+	std::copy(f->constants.begin(), f->constants.end(), stack.begin() + f->numLocals);
+	int *R = stack.data();
+	const BCInstruction *pc = f->code.data();
+
+#define BC_BINARY(opcode, expr) BC_CASE(opcode) { int x = R[pc->src1], y = R[pc->src2]; R[pc->dst] = (expr); } BC_NEXT();
+#define BC_RETURN(value) {\
+		int v = (value);\
+		if (frames.empty()) return v;\
+		auto &caller = frames.back();\
+		f = caller.f;\
+		base = caller.base;\
+		pc = caller.ret;\
+		R = stack.data() + base;\
+		if (caller.dst >= 0) R[caller.dst] = v;\
+		frames.pop_back();\
+	} BC_NEXT();
+
+#ifdef BC_THREADED_DISPATCH
+	// must be kept in the same order as BCInstruction::Opcode
+	static void *const labels[] = {
+		&&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV, &&L_MOD, &&L_SHL, &&L_SHR,
+		&&L_SEQ, &&L_SNE, &&L_SLT, &&L_SLE, &&L_SGT, &&L_SGE,
+		&&L_AND, &&L_OR, &&L_XOR, &&L_INV, &&L_NEG, &&L_MOV,
+		&&L_LOAD, &&L_STORE, &&L_MALLOC,
+		&&L_CALL, &&L_CALL_BUILTIN, &&L_PHI,
+		&&L_JMP, &&L_BR, &&L_RET, &&L_RET_VOID
+	};
+#define BC_CASE(opcode) L_##opcode:
+#define BC_DISPATCH() goto *labels[pc->op]
+#define BC_NEXT() { ++pc; BC_DISPATCH(); }
+	BC_DISPATCH();
+	{
+#else
+#define BC_CASE(opcode) case BCInstruction::opcode:
+#define BC_DISPATCH() continue
+#define BC_NEXT() { ++pc; continue; }
+	for (;;) switch (pc->op) {
+#endif
+	BC_BINARY(ADD, (int)((unsigned)x + (unsigned)y))
+	BC_BINARY(SUB, (int)((unsigned)x - (unsigned)y))
+	BC_BINARY(MUL, (int)((unsigned)x * (unsigned)y))
+	BC_BINARY(DIV, bcDiv(x, y))
+	BC_BINARY(MOD, bcRem(x, y))
+	BC_BINARY(SHL, (int)((unsigned)x << (y & 31)))
+	BC_BINARY(SHR, x >> (y & 31))
+	BC_BINARY(SEQ, x == y)
+	BC_BINARY(SNE, x != y)
+	BC_BINARY(SLT, x < y)
+	BC_BINARY(SLE, x <= y)
+	BC_BINARY(SGT, x > y)
+	BC_BINARY(SGE, x >= y)
+	BC_BINARY(AND, x & y)
+	BC_BINARY(OR, x | y)
+	BC_BINARY(XOR, x ^ y)
+	BC_CASE(INV) R[pc->dst] = ~R[pc->src1]; BC_NEXT();
+	BC_CASE(NEG) R[pc->dst] = (int)(0u - (unsigned)R[pc->src1]); BC_NEXT();
+	BC_CASE(MOV) R[pc->dst] = R[pc->src1]; BC_NEXT();
+	BC_CASE(LOAD) R[pc->dst] = M.load(R[pc->src1]); BC_NEXT();
+	BC_CASE(STORE) M.store(R[pc->dst], R[pc->src1]); BC_NEXT();
+	BC_CASE(MALLOC) R[pc->dst] = M.allocate_memory(R[pc->src1]); BC_NEXT();
+	BC_CASE(CALL) {
+		BCFunction *callee = program.functions[pc->src1].get();
+		int newBase = base + f->frameSize();
+		if (newBase + callee->frameSize() > stack.size()) {
+			stack.resize(std::max(stack.size() * 2, (size_t)(newBase + callee->frameSize())));
+			R = stack.data() + base;
+		}
+		int *C = stack.data() + newBase;
+		const int *args = f->argSlots.data() + pc->aux;
+		for (int k = 0; k < pc->src2; k++) C[k] = R[args[k]];
+		std::fill(C + pc->src2, C + callee->numLocals, 0);
+		std::copy(callee->constants.begin(), callee->constants.end(), C + callee->numLocals);
+
+		frames.push_back({ f, pc, base, pc->dst });
+		f = callee;
+		base = newBase;
+		R = C;
+		pc = callee->code.data();
+		BC_DISPATCH();
+	}
+	BC_CASE(CALL_BUILTIN) {
+		const int *args = f->argSlots.data() + pc->aux;
+		argv.assign(args, args + pc->src2);
+		for (auto &v : argv) v = R[v];
+		int v = builtins[pc->src1](*this, argv);
+		if (pc->dst >= 0) R[pc->dst] = v;
+		BC_NEXT();
+	}
+	BC_CASE(PHI) {
+		auto &group = f->phiGroups[pc->aux];
+		auto option = group.options.begin();
+		while (option != group.options.end() && option->first != from) option++;
+		if (option == group.options.end()) throw Error("bytecode: no active option for phi-function");
+		argv.resize(group.dsts.size());
+		for (int k = 0; k < group.dsts.size(); k++) argv[k] = R[option->second[k]];
+		for (int k = 0; k < group.dsts.size(); k++) R[group.dsts[k]] = argv[k];
+		BC_NEXT();
+	}
+	BC_CASE(JMP) {
+		from = pc->aux;
+		pc = f->code.data() + pc->src1;
+		BC_DISPATCH();
+	}
+	BC_CASE(BR) {
+		from = pc->aux;
+		pc = f->code.data() + (R[pc->dst] ? pc->src1 : pc->src2);
+		BC_DISPATCH();
+	}
+	BC_CASE(RET) BC_RETURN(R[pc->dst])
+	BC_CASE(RET_VOID) BC_RETURN(0)
+	}
+
+#undef BC_BINARY
+#undef BC_RETURN
+#undef BC_CASE
+#undef BC_DISPATCH
+#undef BC_NEXT
+	return 0;
 }
@@ -3,19 +3,45 @@
 #include "pch.h"
 #include "configuration.h"
 #include "vm.h"
+#include "bytecode.h"
+#include "IR.h"
 
 // #define SHOW_LOG
 
+/*
+Usage: IR_Interpreter(irText, output, input, mode).run();
+       IR_Interpreter(ir, output, input).run();
+In BYTECODE mode the parsed IR is lowered into <BCProgram> before execution,
+STRING_DISPATCH mode interprets the parsed text directly and is kept for
+cross-checking.
+The second form lowers the in-memory <IR> into <BCProgram> directly,
+without printing and re-parsing it (always in BYTECODE mode).
+*/
 class IR_Interpreter {
 public:
-	IR_Interpreter(std::istream &_is, std::ostream &_os = std::cout)
-		:is(_is), os(_os), user(std::cin) {}
+	enum Mode
+	{
+		STRING_DISPATCH, BYTECODE
+	};
+
+	IR_Interpreter(std::istream &_is, std::ostream &_os = std::cout,
+		std::istream &_user = std::cin, Mode _mode = BYTECODE)
+		:is(&_is), os(_os), user(_user), mode(_mode) {}
+
+	IR_Interpreter(std::shared_ptr<IR> _ir, std::ostream &_os = std::cout, 
+		std::istream &_user = std::cin)
+		:is(nullptr), ir(_ir), os(_os), user(_user), mode(BYTECODE) {}
 
 	void run();
+
+	// check every memory access of the guest (slower, for debugging)
+	void enableBoundsCheck(bool b = true) { M.enableBoundsCheck(b); }
 private:
-	std::istream &is, &user;
+	std::istream *is, &user;   // <is> is null when running an in-memory IR
+	std::shared_ptr<IR> ir;
 	std::ostream &os;
 	MemoryManager M;
+	Mode mode;
 
 	std::map<std::string, std::shared_ptr<VMFunction> > functions;
 	std::vector<std::string> globalVars;
@@ -37,14 +63,35 @@ private:
 		std::map<std::string, int> &args);
 
 	char nextchar() {
-		char ch = is.get();
-		while (isspace(ch)) ch = is.get();
-		is.unget();
+		char ch = is->get();
+		while (isspace(ch)) ch = is->get();
+		is->unget();
 		return ch;
 	}
 
 	std::stack<std::string> lastBlockName, curblockName;
 	int getPhiVal(std::vector<std::string> &V, std::map<std::string, int> &local);
+
+	// bytecode engine
+	BCProgram program;
+	std::vector<std::function<int(IR_Interpreter &, const std::vector<int> &)> > builtins;
+	std::map<std::string, int> builtinIndex, functionIndex;
+
+	void lower();
+	void lowerFunction(std::shared_ptr<VMFunction> vf, std::shared_ptr<BCFunction> f);
+	int lowerOperand(const std::string &name, std::map<std::string, int> &slots, 
+		std::shared_ptr<BCFunction> f);
+	int resolveCallee(const std::string &name, bool &isBuiltin);
+
+	// lowering from the in-memory IR
+	std::map<Register *, int> globalAddr;  // global variables and static strings
+
+	void lowerIR();
+	void lowerFunction(std::shared_ptr<Function> irf, std::shared_ptr<BCFunction> f);
+	int lowerOperand(std::shared_ptr<Operand> op, std::map<Register *, int> &slots,
+		std::shared_ptr<BCFunction> f);
+
+	int executeBytecode();
 	// builtin function
 public:
 	using Args = const std::vector<int> &;
@@ -86,12 +133,12 @@ static const std::map<std::string, std::function<int(IR_Interpreter &, IR_Interp
 	{"string.add",&IR_Interpreter::string_add},
 	{"string.eq",&IR_Interpreter::string_eq}, 
 	{"string.neq",&IR_Interpreter::string_neq},
-	{"string.less",&IR_Interpreter::string_less},
-	{"string.leq",&IR_Interpreter::string_leq},
-	{"string.greater",&IR_Interpreter::string_greater}, 
-	{"string.geq",&IR_Interpreter::string_geq},
+	{"string.lt",&IR_Interpreter::string_less},
+	{"string.le",&IR_Interpreter::string_leq},
+	{"string.gt",&IR_Interpreter::string_greater}, 
+	{"string.ge",&IR_Interpreter::string_geq},
 	{"getInt",&IR_Interpreter::getInt}, 
 	{"printInt",&IR_Interpreter::printInt},
-	{"printIntln",&IR_Interpreter::printIntln}, 
+	{"printlnInt",&IR_Interpreter::printIntln}, 
 	{"toString", &IR_Interpreter::toString}
 };
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include "linearScanAllocator.h"
+#include <algorithm>
+
+
+LinearScanAllocator::~LinearScanAllocator()
+{
+	for (auto f : program->getFunctions())
+		for (auto b : f->getBlockList())
+			for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+				for (auto r : i->getUseReg()) r->info().clear();
+				if (i->getDefReg() != nullptr) i->getDefReg()->info().clear();
+			}
+}
+
+void LinearScanAllocator::run()
+{
+	auto functions = program->getFunctions();
+	for (auto &function : functions) {
+		f = function;
+		f->computePreOrderList();
+		while (true)
+		{
+			init();
+			livenessAnalysis();
+			buildIntervals();
+			allocate();
+			if (spilled.empty()) break;
+			rewrite();
+		}
+		applyColoring(f);
+	}
+}
+
+bool LinearScanAllocator::Interval::covers(int pos)
+{
+	while (cursor < ranges.size() && ranges[cursor].to <= pos) cursor++;
+	return cursor < ranges.size() && ranges[cursor].from <= pos;
+}
+
+void LinearScanAllocator::init()
+{
+	nodes.clear();
+	intervals.clear();
+	spilled.clear();
+
+	// the physical registers take the first ids, only the allocatable ones are tracked
+	program->resetPrecoloredRegs();
+	for (auto &reg : preColored) newNode(reg);
+	for (auto regName : RISCVConfig::allocatableRegNames) {
+		int r = id((*program)[regName]);
+		intervals[r].reg = r;
+	}
+	if (regOrder.empty()) {
+		for (auto regName : RISCVConfig::callerSaveRegNames) regOrder.push_back(id((*program)[regName]));
+		for (auto regName : RISCVConfig::calleeSaveRegNames) regOrder.push_back(id((*program)[regName]));
+	}
+
+	for (auto b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			for (auto reg : i->getUseReg())
+				if (reg->category() != Operand::PHISICAL) reg->info().clear();
+			auto reg = i->getDefReg();
+			if (reg != nullptr && reg->category() != Operand::PHISICAL) reg->info().clear();
+		}
+	for (auto b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			for (auto reg : i->getUseReg())
+				if (reg->category() != Operand::PHISICAL && id(reg) < 0) newNode(reg);
+			auto reg = i->getDefReg();
+			if (reg != nullptr && reg->category() != Operand::PHISICAL && id(reg) < 0) newNode(reg);
+		}
+}
+
+void LinearScanAllocator::livenessAnalysis()
+{
+	auto &blocks = f->getBlockList();
+	size_t n = blocks.size(), N = nodes.size();
+	blockIndex.clear();
+	for (size_t bi = 0; bi < n; bi++) blockIndex[blocks[bi].get()] = bi;
+	std::vector<BitVector> livein(n, BitVector(N)), def(n, BitVector(N)), use(n, BitVector(N));
+	liveout.assign(n, BitVector(N));
+
+	for (size_t bi = 0; bi < n; bi++) {
+		for (auto i = blocks[bi]->getFront(); i != nullptr; i = i->getNextInstr()) {
+			for (auto reg : i->getUseReg())
+				if (!def[bi].test(id(reg))) use[bi].set(id(reg));
+			if (i->getDefReg() != nullptr) def[bi].set(id(i->getDefReg()));
+			if (i->category() == RISCVinstruction::CALL) {
+				for (auto regName : RISCVConfig::callerSaveRegNames)
+					def[bi].set(id((*program)[regName]));
+			}
+		}
+	}
+
+	std::vector<int> worklist;
+	std::vector<bool> inList(n, true);
+	for (size_t bi = 0; bi < n; bi++) worklist.push_back(bi);
+	while (!worklist.empty()) {
+		int bi = worklist.back();
+		worklist.pop_back();
+		inList[bi] = false;
+
+		auto &out = liveout[bi];
+		for (auto &bb : blocks[bi]->getToBlocks()) out.unionWith(livein[blockIndex[bb.get()]]);
+		BitVector in = out;
+		in.subtract(def[bi]);
+		in.unionWith(use[bi]);
+		if (in != livein[bi]) {
+			livein[bi] = std::move(in);
+			for (auto &bb : blocks[bi]->getFromBlocks()) {
+				auto it = blockIndex.find(bb.get());
+				if (it != blockIndex.end() && !inList[it->second]) {
+					inList[it->second] = true;
+					worklist.push_back(it->second);
+				}
+			}
+		}
+	}
+}
+
+void LinearScanAllocator::buildIntervals()
+{
+	auto &blocks = f->getBlockList();
+	int n = blocks.size(), P = preColored.size();
+	positionOf.assign(n + 1, 0);
+	for (int bi = 0; bi < n; bi++) {
+		int cnt = 0;
+		for (auto i = blocks[bi]->getFront(); i != nullptr; i = i->getNextInstr()) cnt++;
+		positionOf[bi + 1] = positionOf[bi] + 2 * cnt;
+	}
+
+	for (int bi = n - 1; bi >= 0; bi--) {
+		int from = positionOf[bi], to = positionOf[bi + 1];
+		auto live = liveout[bi];
+		live.forEach([&](size_t r) { if (isTracked(r)) addRange(r, from, to); });
+
+		int p = to - 2, openUntil = -1;
+		for (auto i = blocks[bi]->getBack(); i != nullptr; i = i->getPrevInstr(), p -= 2) {
+			auto def = i->getDefReg();
+			if (def != nullptr && isTracked(id(def))) {
+				int d = id(def);
+				if (live.test(d)) setFrom(d, p + 1);
+				// CALL and RET read the argument, return value and callee-save registers
+				else addRange(d, p + 1, (d < P && openUntil > p) ? openUntil + 1 : p + 2);
+				live.reset(d);
+			}
+			if (i->category() == RISCVinstruction::CALL) {
+				for (auto regName : RISCVConfig::callerSaveRegNames) {
+					int d = id((*program)[regName]);
+					if (live.test(d)) setFrom(d, p + 1);
+					else addRange(d, p + 1, p + 2);
+					live.reset(d);
+				}
+			}
+			if (i->category() == RISCVinstruction::CALL || i->category() == RISCVinstruction::RET) openUntil = p;
+
+			// the address temporary of a global store is written while the value is still needed
+			int useEnd = (i->category() == RISCVinstruction::STORE && def != nullptr) ? p + 2 : p + 1;
+			auto uses = i->getUseReg();
+			for (auto &reg : uses)
+				if (isTracked(id(reg))) {
+					addRange(id(reg), from, useEnd);
+					live.set(id(reg));
+				}
+
+			if (i->category() == RISCVinstruction::MOV) {
+				int rd = id(def), rs = id(uses[0]);
+				if (rd >= P && intervals[rd].hint < 0) intervals[rd].hint = rs;
+				if (rs >= P && intervals[rs].hint < 0) intervals[rs].hint = rd;
+			}
+		}
+	}
+	finishIntervals();
+}
+
+void LinearScanAllocator::allocate()
+{
+	int P = preColored.size(), N = nodes.size();
+	std::vector<int> unhandled, active, inactive;
+	for (int n = P; n < N; n++)
+		if (!intervals[n].ranges.empty()) unhandled.push_back(n);
+	std::stable_sort(unhandled.begin(), unhandled.end(),
+		[&](int x, int y) { return intervals[x].start() < intervals[y].start(); });
+
+	std::vector<int> blockers(P);
+	for (auto n : unhandled) {
+		auto &current = intervals[n];
+		int pos = current.start();
+
+		size_t k = 0, l = 0;
+		std::vector<int> reactivated;
+		for (auto a : inactive) {
+			if (intervals[a].end() <= pos) continue;
+			if (intervals[a].covers(pos)) reactivated.push_back(a);
+			else inactive[l++] = a;
+		}
+		inactive.resize(l);
+		for (auto a : active) {
+			if (intervals[a].end() <= pos) continue;
+			if (intervals[a].covers(pos)) active[k++] = a;
+			else inactive.push_back(a);
+		}
+		active.resize(k);
+		active.insert(active.end(), reactivated.begin(), reactivated.end());
+
+		// count for every register the intervals that keep it from <current>
+		std::fill(blockers.begin(), blockers.end(), 0);
+		for (auto a : active) blockers[intervals[a].reg]++;
+		for (auto a : inactive)
+			if (intersects(intervals[a], current)) blockers[intervals[a].reg]++;
+		for (auto r : regOrder)
+			if (intersects(intervals[r], current)) blockers[r]++;
+
+		int reg = -1, hint = current.hint;
+		if (hint >= P) hint = intervals[hint].reg;
+		if (hint >= 0 && hint < P && intervals[hint].reg >= 0 && blockers[hint] == 0) reg = hint;
+		else for (auto r : regOrder)
+			if (blockers[r] == 0) {
+				reg = r;
+				break;
+			}
+
+		if (reg < 0) {
+			// take the register of the active interval that ends last, if nothing else holds it
+			int victim = -1;
+			for (auto a : active)
+				if (!isForSpill[nodes[a]] && blockers[intervals[a].reg] == 1
+					&& (victim < 0 || intervals[a].end() > intervals[victim].end()))
+					victim = a;
+
+			if (victim >= 0 && (isForSpill[nodes[n]] || intervals[victim].end() > current.end())) {
+				reg = intervals[victim].reg;
+				intervals[victim].reg = -1;
+				spilled.push_back(victim);
+				active.erase(std::find(active.begin(), active.end(), victim));
+			}
+			else {
+				if (isForSpill[nodes[n]])
+					throw Error("no register left for a spilled value.");
+				spilled.push_back(n);
+				continue;
+			}
+		}
+		current.reg = reg;
+		active.push_back(n);
+	}
+
+	for (int n = P; n < N; n++)
+		if (intervals[n].reg >= 0) nodes[n]->info().color = preColored[intervals[n].reg];
+}
+
+void LinearScanAllocator::rewrite()
+{
+	for (auto n : spilled)
+		nodes[n]->info().spilladdr = newSpillSlot(f, (*program)["sp"]);
+	insertSpillCode(f, isForSpill);
+}
+
+int LinearScanAllocator::newNode(std::shared_ptr<Register> reg)
+{
+	int n = nodes.size();
+	reg->info().id = n;
+	nodes.push_back(reg);
+	intervals.emplace_back();
+	return n;
+}
+
+void LinearScanAllocator::addRange(int n, int from, int to)
+{
+	if (from >= to) return;
+	auto &ranges = intervals[n].ranges;  // reversed while building
+	if (!ranges.empty() && to >= ranges.back().from) {
+		ranges.back().from = std::min(ranges.back().from, from);
+		ranges.back().to = std::max(ranges.back().to, to);
+		while (ranges.size() >= 2 && ranges[ranges.size() - 2].from <= ranges.back().to) {
+			ranges[ranges.size() - 2].from = ranges.back().from;
+			ranges[ranges.size() - 2].to = std::max(ranges[ranges.size() - 2].to, ranges.back().to);
+			ranges.pop_back();
+		}
+	}
+	else ranges.push_back({ from, to });
+}
+
+void LinearScanAllocator::setFrom(int n, int from)
+{
+	auto &ranges = intervals[n].ranges;
+	if (ranges.empty()) ranges.push_back({ from, from + 1 });
+	else ranges.back().from = from;
+}
+
+void LinearScanAllocator::finishIntervals()
+{
+	for (auto &interval : intervals) {
+		std::reverse(interval.ranges.begin(), interval.ranges.end());
+		interval.cursor = 0;
+	}
+}
+
+bool LinearScanAllocator::intersects(const Interval &a, const Interval &b)
+{
+	auto &x = a.ranges, &y = b.ranges;
+	if (x.empty() || y.empty()) return false;
+	auto firstEndingAfter = [](const std::vector<Range> &ranges, int pos) {
+		return std::partition_point(ranges.begin(), ranges.end(),
+			[pos](const Range &r) { return r.to <= pos; }) - ranges.begin();
+	};
+	size_t i = firstEndingAfter(x, y.front().from), j = firstEndingAfter(y, x.front().from);
+	while (i < x.size() && j < y.size()) {
+		if (x[i].to <= y[j].from) i++;
+		else if (y[j].to <= x[i].from) j++;
+		else return true;
+	}
+	return false;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "pch.h"
+#include "RISCVassembly.h"
+#include "configuration.h"
+#include "BitVector.h"
+#include "registerAllocator.h"
+#include <unordered_map>
+
+/*
+Class: LinearScanAllocator
+Linear scan with lifetime holes (Wimmer & Moessenboeck), without interval splitting.
+It is the fast alternative to <RegisterAllocator>, c.f. MxCompiler::O1.
+Instructions are numbered along the block order of computePreOrderList: an
+instruction at position p reads its operands at p and writes its result at p + 1.
+Every register gets a sorted list of live ranges; the allocatable physical
+registers get fixed intervals (a CALL clobbers the caller-save ones, and a
+physical register written before a CALL or RET stays live up to it).
+An interval that can not keep one register for its whole lifetime is spilled,
+either itself or the active interval that ends last. Spill code is inserted as
+in <RegisterAllocator> and the new short intervals are allocated in another round.
+*/
+class LinearScanAllocator {
+public:
+	LinearScanAllocator(std::shared_ptr<RISCVProgram> _program)
+		:program(_program) {
+		for (auto regName : RISCVConfig::physicalRegNames)
+			preColored.push_back((*program)[regName]);
+	}
+
+	~LinearScanAllocator();
+
+	void run();
+
+private:
+	struct Range {
+		int from, to;  // [from, to)
+	};
+	struct Interval {
+		std::vector<Range> ranges;  // increasing and disjoint once built
+		size_t cursor = 0;          // first range that may still cover the current position
+		int reg = -1, hint = -1;
+
+		int start() const { return ranges.front().from; }
+		int end() const { return ranges.back().to; }
+		bool covers(int pos);  // pos must not decrease between calls
+	};
+
+	std::shared_ptr<RISCVProgram> program;
+	std::vector<std::shared_ptr<PhysicalRegister> > preColored;
+	std::shared_ptr<RISCVFunction> f;
+
+	// registers, indexed by RAinfo::id (the physical ones first)
+	std::vector<std::shared_ptr<Register> > nodes;
+	std::vector<Interval> intervals;
+	std::vector<int> spilled;
+
+	std::vector<int> positionOf;  // block index -> position of its first instruction
+	std::unordered_map<RISCVBasicBlock *, int> blockIndex;
+	std::vector<BitVector> liveout;
+
+	std::vector<int> regOrder;  // allocatable physical ids, caller-save first
+	std::map<std::shared_ptr<Register>, bool> isForSpill;
+
+	void init();
+	void livenessAnalysis();
+	void buildIntervals();
+	void allocate();
+	void rewrite();
+
+	/***************************** helper functions******************************/
+	int id(std::shared_ptr<Register> reg) { return reg->info().id; }
+	int newNode(std::shared_ptr<Register> reg);
+	// the non-allocatable physical registers (zero, sp, ...) get no interval
+	bool isTracked(int n) { return n >= (int)preColored.size() || intervals[n].reg >= 0; }
+
+	// ranges are built backwards: <addRange> prepends, merging with the first range
+	void addRange(int n, int from, int to);
+	void setFrom(int n, int from);
+	void finishIntervals();
+
+	static bool intersects(const Interval &a, const Interval &b);
+};
@@ -0,0 +1,99 @@
+#include "loop.h"
+
+std::shared_ptr<BasicBlock> NaturalLoop::getPreheader()
+{
+	std::shared_ptr<BasicBlock> preheader = nullptr;
+	for (auto &p : header->getBlocksFrom())
+		if (!contains(p)) {
+			if (preheader != nullptr) return nullptr;
+			preheader = p;
+		}
+	if (preheader == nullptr || preheader->getBlocksTo().size() != 1) return nullptr;
+	return preheader;
+}
+
+std::vector<std::shared_ptr<BasicBlock> > NaturalLoop::getExitingBlocks()
+{
+	std::vector<std::shared_ptr<BasicBlock> > exiting;
+	for (auto &b : blocks)
+		for (auto &s : b->getBlocksTo())
+			if (!contains(s)) {
+				exiting.push_back(b);
+				break;
+			}
+	return exiting;
+}
+
+LoopNest::LoopNest(std::shared_ptr<Function> f)
+{
+	auto dt = f->getDT();
+	std::set<BasicBlock *> reachable;
+	for (auto &b : f->getBlockList()) reachable.insert(b.get());
+
+	std::map<std::shared_ptr<BasicBlock>, std::shared_ptr<NaturalLoop> > byHeader;
+	std::vector<std::shared_ptr<NaturalLoop> > loops;
+	for (auto &b : f->getBlockList())
+		for (auto &h : b->getBlocksTo())
+			if (dt->isDominating(h, b)) {  // back edge b -> h
+				auto &l = byHeader[h];
+				if (l == nullptr) {
+					l = std::make_shared<NaturalLoop>(h);
+					loops.push_back(l);
+				}
+				l->latches.push_back(b);
+			}
+
+	for (auto &l : loops) {
+		l->blocks.insert(l->header);
+		std::vector<std::shared_ptr<BasicBlock> > work;
+		for (auto &latch : l->latches)
+			if (l->blocks.insert(latch).second) work.push_back(latch);
+		while (!work.empty()) {
+			auto b = work.back();
+			work.pop_back();
+			for (auto &p : b->getBlocksFrom())
+				if (reachable.find(p.get()) != reachable.end() && l->blocks.insert(p).second)
+					work.push_back(p);
+		}
+	}
+
+	// outer loops first, so the innermost loop of each block is the last one written
+	std::stable_sort(loops.begin(), loops.end(), [](const std::shared_ptr<NaturalLoop> &a, const std::shared_ptr<NaturalLoop> &b) {
+		return a->blocks.size() > b->blocks.size();
+	});
+	for (auto &l : loops) {
+		auto it = innermost.find(l->header.get());
+		if (it == innermost.end()) topLevel.push_back(l);
+		else {
+			l->parent = it->second.get();
+			l->depth = l->parent->depth + 1;
+			it->second->children.push_back(l);
+		}
+		for (auto &b : l->blocks) innermost[b.get()] = l;
+	}
+}
+
+std::vector<std::shared_ptr<NaturalLoop> > LoopNest::getLoopsInnermostFirst()
+{
+	std::vector<std::shared_ptr<NaturalLoop> > order;
+	for (auto &l : topLevel) postOrder(l, order);
+	return order;
+}
+
+std::shared_ptr<NaturalLoop> LoopNest::getLoopFor(std::shared_ptr<BasicBlock> b)
+{
+	auto it = innermost.find(b.get());
+	return it == innermost.end() ? nullptr : it->second;
+}
+
+int LoopNest::getLoopDepth(std::shared_ptr<BasicBlock> b)
+{
+	auto l = getLoopFor(b);
+	return l == nullptr ? 0 : l->getDepth();
+}
+
+void LoopNest::postOrder(std::shared_ptr<NaturalLoop> l, std::vector<std::shared_ptr<NaturalLoop> > &order)
+{
+	for (auto &c : l->children) postOrder(c, order);
+	order.push_back(l);
+}
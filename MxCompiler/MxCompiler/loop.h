@@ -0,0 +1,67 @@
+#pragma once
+
+#include "pch.h"
+#include "Function.h"
+#include "basicblock.h"
+#include "dominance.h"
+
+/*
+Class: NaturalLoop
+A natural loop: the header plus every block that reaches one of the back
+edges (latch -> header) without passing through the header.
+Loops sharing a header are merged into one.
+*/
+class NaturalLoop {
+public:
+	NaturalLoop(std::shared_ptr<BasicBlock> _header) :header(_header), parent(nullptr), depth(1) {}
+
+	std::shared_ptr<BasicBlock> getHeader() { return header; }
+	std::vector<std::shared_ptr<BasicBlock> > &getLatches() { return latches; }
+	std::set<std::shared_ptr<BasicBlock> > &getBlocks() { return blocks; }
+	bool contains(std::shared_ptr<BasicBlock> b) { return blocks.find(b) != blocks.end(); }
+
+	NaturalLoop *getParent() { return parent; }
+	std::vector<std::shared_ptr<NaturalLoop> > &getChildren() { return children; }
+	int getDepth() { return depth; }
+
+	// the unique predecessor out of the loop that only jumps to the header, or null
+	std::shared_ptr<BasicBlock> getPreheader();
+	// blocks in the loop with a successor out of the loop
+	std::vector<std::shared_ptr<BasicBlock> > getExitingBlocks();
+
+private:
+	friend class LoopNest;
+
+	std::shared_ptr<BasicBlock> header;
+	std::vector<std::shared_ptr<BasicBlock> > latches;
+	std::set<std::shared_ptr<BasicBlock> > blocks;
+
+	NaturalLoop *parent;
+	std::vector<std::shared_ptr<NaturalLoop> > children;
+	int depth;
+};
+
+/*
+Class: LoopNest
+Discovers the natural loops of a function from the back edges on its
+<DominatorTree> (so f->getDT() must be up to date) and arranges them into a
+tree by containment. Irreducible cycles are not reported.
+*/
+class LoopNest {
+public:
+	LoopNest(std::shared_ptr<Function> f);
+
+	std::vector<std::shared_ptr<NaturalLoop> > &getTopLevelLoops() { return topLevel; }
+	// every loop, inner loops before the loops containing them
+	std::vector<std::shared_ptr<NaturalLoop> > getLoopsInnermostFirst();
+
+	// the innermost loop containing b, or null
+	std::shared_ptr<NaturalLoop> getLoopFor(std::shared_ptr<BasicBlock> b);
+	int getLoopDepth(std::shared_ptr<BasicBlock> b);
+
+private:
+	std::vector<std::shared_ptr<NaturalLoop> > topLevel;
+	std::map<BasicBlock *, std::shared_ptr<NaturalLoop> > innermost;
+
+	void postOrder(std::shared_ptr<NaturalLoop> l, std::vector<std::shared_ptr<NaturalLoop> > &order);
+};
@@ -18,17 +18,20 @@ void RegisterAllocator::run()
 	for (auto &function : functions) {
 		f = function;
 		f->computePreOrderList();
+		f->computeLoopDepth();
+		splitAroundCalls();
 		while (true)
 		{
 			init();
 			livenessAnalysis();
 			buildInferenceGraph();
 			collect();
-			while (!simplifySet.empty() || !moveSet.empty() || !freezeSet.empty() || !spillSet.empty()) {
-				if (!simplifySet.empty()) simplify();
-				else if (!moveSet.empty()) coalesce();
-				else if (!freezeSet.empty()) freeze();
-				else select();
+			while (true) {
+				int n, m;
+				if ((n = pop(simplifyWorklist, SIMPLIFY)) >= 0) simplify(n);
+				else if ((m = popMove()) >= 0) coalesce(m);
+				else if ((n = pop(freezeWorklist, FREEZE)) >= 0) freeze(n);
+				else if (!select()) break;
 			}
 			assignColor();
 			if (spilled.empty()) break;
@@ -38,244 +41,391 @@ void RegisterAllocator::run()
 	}
 }
 
+void RegisterAllocator::splitAroundCalls()
+{
+	splitMoves.clear();
+	init();
+	livenessAnalysis();
+
+	// the deepest loop each register occurs in
+	int P = preColored.size();
+	std::vector<int> maxDepth(nodes.size(), 0);
+	for (auto b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			for (auto reg : i->getUseReg()) maxDepth[id(reg)] = std::max(maxDepth[id(reg)], b->getLoopDepth());
+			if (i->getDefReg() != nullptr)
+				maxDepth[id(i->getDefReg())] = std::max(maxDepth[id(i->getDefReg())], b->getLoopDepth());
+		}
+
+	auto &blocks = f->getBlockList();
+	for (size_t bi = 0; bi < blocks.size(); bi++) {
+		auto live = liveout[bi];
+		int depth = blocks[bi]->getLoopDepth();
+		std::shared_ptr<RISCVinstruction> prev;
+		for (auto i = blocks[bi]->getBack(); i != nullptr; i = prev) {
+			prev = i->getPrevInstr();
+			if (i->category() == RISCVinstruction::CALL) {
+				std::vector<int> across;
+				live.forEach([&](size_t r) {
+					if ((int)r >= P && maxDepth[r] > depth && rematDef[r] == nullptr) across.push_back(r);
+				});
+				for (auto r : across) {
+					auto temp = std::make_shared<VirtualReg>(Operand::REG_VAL, "split");
+					auto save = std::make_shared<MoveAssembly>(i->getBlock(), temp, nodes[r]);
+					auto restore = std::make_shared<MoveAssembly>(i->getBlock(), nodes[r], temp);
+					appendBefore(i, save);
+					appendAfter(i, restore);
+					splitMoves.insert(save);
+					splitMoves.insert(restore);
+				}
+			}
+			if (i->getDefReg() != nullptr) live.reset(id(i->getDefReg()));
+			for (auto &reg : i->getUseReg()) live.set(id(reg));
+		}
+	}
+}
+
 void RegisterAllocator::init()
 {
-	clear();
-	for(auto b : f->getBlockList())
+	nodes.clear();
+	state.clear();
+	degree.clear();
+	alias.clear();
+	color.clear();
+	spillPriority.clear();
+	adjList.clear();
+	moveList.clear();
+	partners.clear();
+	simplifyWorklist.clear();
+	freezeWorklist.clear();
+	spillWorklist.clear();
+	selectStack.clear();
+	spilled.clear();
+	moves.clear();
+	moveState.clear();
+	moveWorklist.clear();
+
+	// reset the precolored registers, they always take the first ids
+	program->resetPrecoloredRegs();
+	for (auto &reg : preColored) newNode(reg, PRECOLORED);
+
+	if (colorBit.empty()) {
+		colorBit.assign(preColored.size(), -1);
+		for (int k = 0; k < K; k++) colorBit[id((*program)[RISCVConfig::allocatableRegNames[k]])] = k;
+		for (auto regName : RISCVConfig::calleeSaveRegNames) colorOrder.push_back(id((*program)[regName]));
+		for (auto regName : RISCVConfig::callerSaveRegNames) colorOrder.push_back(id((*program)[regName]));
+	}
+
+	for (auto b : f->getBlockList())
 		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
 			for (auto reg : i->getUseReg())
-				initial.insert(reg);
-			if (i->getDefReg() != nullptr) 
-				initial.insert(i->getDefReg());
+				if (reg->category() != Operand::PHISICAL) reg->info().clear();
+			auto reg = i->getDefReg();
+			if (reg != nullptr && reg->category() != Operand::PHISICAL) reg->info().clear();
 		}
-	for (auto reg : initial) reg->info().clear();
-	
-	// reset the precolored registers
-	program->resetPrecoloredRegs();
+	for (auto b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			for (auto reg : i->getUseReg())
+				if (reg->category() != Operand::PHISICAL && id(reg) < 0) newNode(reg, INITIAL);
+			auto reg = i->getDefReg();
+			if (reg != nullptr && reg->category() != Operand::PHISICAL && id(reg) < 0) newNode(reg, INITIAL);
+		}
+
+	rematDef.assign(nodes.size(), nullptr);
+	for (auto &it : findRematerializable(f)) rematDef[id(it.first)] = it.second;
 
 	// compute priority
 	for (auto &b : f->getBlockList()) {
-		int w = (int)std::pow(10,std::min(b->getToBlocks().size(), b->getFromBlocks().size()));
+		double w = std::pow(10, std::min(b->getLoopDepth(), (int)MAX_WEIGHTED_DEPTH));
 		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
-			for (auto reg : i->getUseReg()) spillPriority[reg] += w;
-			if (i->getDefReg() != nullptr) spillPriority[i->getDefReg()] += w;
+			for (auto reg : i->getUseReg()) spillPriority[id(reg)] += w;
+			if (i->getDefReg() != nullptr) spillPriority[id(i->getDefReg())] += w;
 		}
 	}
+	// recomputing is cheaper than a reload
+	for (size_t n = preColored.size(); n < nodes.size(); n++)
+		if (rematDef[n] != nullptr) spillPriority[n] /= 2;
+
+	size_t N = nodes.size();
+	adjMatrix = BitVector(N * (N - 1) / 2);
+	mark.assign(N, 0);
+	markStamp = 0;
 }
 
 void RegisterAllocator::buildInferenceGraph()
 {
-	for (auto b : f->getBlockList()) {
-		auto live = liveout[b];
-		for (auto i = b->getBack(); i != nullptr; i = i->getPrevInstr()) { // reversely
+	auto &blocks = f->getBlockList();
+	for (size_t bi = 0; bi < blocks.size(); bi++) {
+		auto live = liveout[bi];
+		for (auto i = blocks[bi]->getBack(); i != nullptr; i = i->getPrevInstr()) { // reversely
 			auto uses = i->getUseReg();
-			if (i->category() == RISCVinstruction::MOV) {
-				for (auto &reg : uses) live.erase(reg);
-				
-				auto move = std::static_pointer_cast<MoveAssembly>(i);
-				i->getDefReg()->info().moveList.insert(move);
-				for (auto &reg : uses) reg->info().moveList.insert(move);
-				moveSet.insert(move);
+			if (i->category() == RISCVinstruction::MOV && splitMoves.find(i) != splitMoves.end()) {
+				for (auto &reg : uses) live.reset(id(reg));
+				int d = id(i->getDefReg()), u = id(uses[0]);
+				partners[d].push_back(u);
+				partners[u].push_back(d);
+			}
+			else if (i->category() == RISCVinstruction::MOV) {
+				for (auto &reg : uses) live.reset(id(reg));
+
+				int m = moves.size();
+				moves.push_back(std::static_pointer_cast<MoveAssembly>(i));
+				moveState.push_back(WORKLIST);
+				moveWorklist.push_back(m);
+				moveList[id(i->getDefReg())].push_back(m);
+				for (auto &reg : uses) moveList[id(reg)].push_back(m);
 			}
 
-			std::vector<std::shared_ptr<Register> > defs;
-			if (i->getDefReg() != nullptr) defs.push_back(i->getDefReg());
+			std::vector<int> defs;
+			if (i->getDefReg() != nullptr) defs.push_back(id(i->getDefReg()));
 
 			if (i->category() == RISCVinstruction::CALL) {
 				for (auto regName : RISCVConfig::callerSaveRegNames)
-					defs.push_back((*program)[regName]);
+					defs.push_back(id((*program)[regName]));
 			}
 
 			if (i->category() == RISCVinstruction::STORE) {
 				auto s = std::static_pointer_cast<Store>(i);
-				if (s->getRt() != nullptr) addEdge(s->getRs(), s->getRt());
+				if (s->getRt() != nullptr) addEdge(id(s->getRs()), id(s->getRt()));
 			}
-			for (auto &def : defs) 
-				for (auto &reg : live) addEdge(def, reg);
-			
-			for (auto &reg : defs) live.erase(reg);
-			for (auto &reg : uses) live.insert(reg);
-			// update liveout
+			for (auto d : defs)
+				live.forEach([&](size_t r) { addEdge(d, r); });
 
+			for (auto d : defs) live.reset(d);
+			for (auto &reg : uses) live.set(id(reg));
 		}
 	}
 }
 
 void RegisterAllocator::livenessAnalysis()
 {
+	auto &blocks = f->getBlockList();
+	size_t n = blocks.size(), N = nodes.size();
+	blockIndex.clear();
+	for (size_t bi = 0; bi < n; bi++) blockIndex[blocks[bi].get()] = bi;
+	livein.assign(n, BitVector(N));
+	liveout.assign(n, BitVector(N));
+	def.assign(n, BitVector(N));
+	use.assign(n, BitVector(N));
+
 	// resolve Use-Def for each block
-	for (auto &b : f->getBlockList()) {
-		def[b].clear();
-		use[b].clear();
-		livein[b].clear();
-		liveout[b].clear();
-		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+	for (size_t bi = 0; bi < n; bi++) {
+		for (auto i = blocks[bi]->getFront(); i != nullptr; i = i->getNextInstr()) {
 			for (auto reg : i->getUseReg())
-				if (def[b].find(reg) == def[b].end()) use[b].insert(reg);
+				if (!def[bi].test(id(reg))) use[bi].set(id(reg));
+
+			if (i->getDefReg() != nullptr) def[bi].set(id(i->getDefReg()));
 
-			if (i->getDefReg() != nullptr) def[b].insert(i->getDefReg());
-			
 			if (i->category() == RISCVinstruction::CALL) {
 				for (auto regName : RISCVConfig::callerSaveRegNames)
-					def[b].insert((*program)[regName]);
+					def[bi].set(id((*program)[regName]));
 			}
 		}
 	}
 
-	bool changed;
-	do{
-		changed = false;
-		auto blocks = f->getBlockList();
-		for (int i = blocks.size() - 1; i >= 0; i--) {
-			auto &b = blocks[i];
-
-			std::set<std::shared_ptr<Register> > new_out, new_in = liveout[b];
-			for (auto reg : def[b]) new_in.erase(reg);
-			for (auto reg : use[b]) new_in.insert(reg);
-			for (auto bb : b->getToBlocks())
-				for (auto reg : livein[bb]) new_out.insert(reg);
-			
-			if (new_in != livein[b] || new_out != liveout[b]) {
-				changed = true;  
-				livein[b] = new_in;
-				liveout[b] = new_out;
+	// backward worklist, the blocks are first visited in reverse preorder
+	std::vector<int> worklist;
+	std::vector<bool> inList(n, true);
+	for (size_t bi = 0; bi < n; bi++) worklist.push_back(bi);
+	while (!worklist.empty()) {
+		int bi = worklist.back();
+		worklist.pop_back();
+		inList[bi] = false;
+
+		auto &out = liveout[bi];
+		for (auto &bb : blocks[bi]->getToBlocks()) out.unionWith(livein[blockIndex[bb.get()]]);
+		BitVector in = out;
+		in.subtract(def[bi]);
+		in.unionWith(use[bi]);
+		if (in != livein[bi]) {
+			livein[bi] = std::move(in);
+			for (auto &bb : blocks[bi]->getFromBlocks()) {
+				auto it = blockIndex.find(bb.get());
+				if (it != blockIndex.end() && !inList[it->second]) {
+					inList[it->second] = true;
+					worklist.push_back(it->second);
+				}
 			}
 		}
-	} while (changed);
+	}
 }
 
 void RegisterAllocator::collect()
 {
-	for (auto reg : initial) 
-		if(reg->category() != Operand::PHISICAL){
-			if (reg->info().degree >= K) 
-				spillSet.insert(reg);
-			else if (isMoveRelated(reg)) freezeSet.insert(reg);
-			else simplifySet.insert(reg);
-		}
+	for (size_t n = preColored.size(); n < nodes.size(); n++) {
+		if (degree[n] >= K) push(n, SPILL);
+		else if (isMoveRelated(n)) push(n, FREEZE);
+		else push(n, SIMPLIFY);
+	}
 }
 
-void RegisterAllocator::simplify()
+void RegisterAllocator::simplify(int n)
 {
-	auto reg = *simplifySet.begin(); //  this cannot be a physical register
-	simplifySet.erase(reg);
-	selectStack.push_back(reg);
-	for (auto r : getNeighbors(reg)) decreaseDegreeBy1(r);
-
+	state[n] = SELECTED;
+	selectStack.push_back(n);
+	forEachNeighbor(n, [&](int r) { decreaseDegreeBy1(r); });
 }
 
-void RegisterAllocator::coalesce()
+void RegisterAllocator::coalesce(int m)
 {
-	auto move = *moveSet.begin();
-	moveSet.erase(move);
-	auto x = getAlias(move->getRs1()), y = getAlias(move->getRd());
-	if (preColored.find(y) != preColored.end()) std::swap(x, y);
-	
+	auto move = moves[m];
+	int x = getAlias(id(move->getRs1())), y = getAlias(id(move->getRd()));
+	if (state[y] == PRECOLORED) std::swap(x, y);
+
 	if (x == y) {
-		coalescedMoves.insert(move);
+		moveState[m] = COALESCED_MOVE;
 		enqueue(x);
 	}
-	else if (preColored.find(y) != preColored.end() || edges.find(Edge(x, y)) != edges.end() || x->getName() == "zero") {
-		constrainedMoves.insert(move);
+	else if (state[y] == PRECOLORED || interferes(x, y) || nodes[x]->getName() == "zero") {
+		moveState[m] = CONSTRAINED;
 		enqueue(x);
 		enqueue(y);
 	}
 	else {
 		bool cond = true;
-		if (preColored.find(x) != preColored.end())
-			for (auto r : getNeighbors(y)) cond &= check(r, x);
-		else {
-			auto temp = getNeighbors(x);
-			for (auto r : getNeighbors(y)) temp.insert(r);
-			cond = isConservative(temp);
-		}
+		if (state[x] == PRECOLORED)
+			forEachNeighbor(y, [&](int t) { cond &= check(t, x); });
+		else cond = isConservative(x, y);
 
 		if (cond) {
-			coalescedMoves.insert(move);
+			moveState[m] = COALESCED_MOVE;
 			union_nodes(x, y);
 			enqueue(x);
 		}
-		else activeMoves.insert(move);
+		else {
+			moveState[m] = ACTIVE;
+		}
 	}
 }
 
-void RegisterAllocator::freeze()
+void RegisterAllocator::freeze(int n)
 {
-	auto r = *freezeSet.begin();   // this cannot be a physical register.
-	freezeSet.erase(r);
-	simplifySet.insert(r);
-	freezeMoves(r);
+	push(n, SIMPLIFY);
+	freezeMoves(n);
 }
 
-void RegisterAllocator::select()
+bool RegisterAllocator::select()
 {
-	auto reg = *spillSet.begin();
-
-	for (auto r : spillSet)
-		if (isForSpill[reg] || (!isForSpill[r] &&
-			(double)spillPriority[r] / r->info().degree < (double)spillPriority[reg] / reg->info().degree))
+	// drop the stale entries while looking for the cheapest node to spill
+	int reg = -1;
+	size_t k = 0;
+	for (auto r : spillWorklist) {
+		if (state[r] != SPILL) continue;
+		spillWorklist[k++] = r;
+		if (reg < 0 || isForSpill[nodes[reg]] || (!isForSpill[nodes[r]] &&
+			(double)spillPriority[r] / degree[r] < (double)spillPriority[reg] / degree[reg]))
 			reg = r;
-	spillSet.erase(reg);
-	simplifySet.insert(reg);
+	}
+	spillWorklist.resize(k);
+	if (reg < 0) return false;
+
+	push(reg, SIMPLIFY);
 	freezeMoves(reg);
+	return true;
 }
 
 void RegisterAllocator::assignColor()
 {
 	while (!selectStack.empty()) {
-		auto reg = selectStack.back();
+		int n = selectStack.back();
 		selectStack.pop_back();
 
-		auto availableColors = program->getAllocatableRegs();
-
-		for (auto r : reg->info().adjList) {
-			auto r_alias = getAlias(r);
-			if (colored.find(r_alias) != colored.end() || preColored.find(r_alias) != preColored.end())
-				availableColors.erase(r_alias->info().color);
+		uint64_t availableColors = ((uint64_t)1 << K) - 1;
+		for (auto r : adjList[n]) {
+			int r_alias = getAlias(r);
+			if ((state[r_alias] == COLORED || state[r_alias] == PRECOLORED) && colorBit[color[r_alias]] >= 0)
+				availableColors &= ~((uint64_t)1 << colorBit[color[r_alias]]);
 		}
 
-		if (availableColors.empty()) 
-				spilled.insert(reg);
+		if (availableColors == 0) {
+			state[n] = SPILLED;
+			spilled.push_back(n);
+		}
 		else {
-			colored.insert(reg);
-			
-			std::shared_ptr<PhysicalRegister> color;
-			for(auto regName : RISCVConfig::calleeSaveRegNames)
-				if (availableColors.find((*program)[regName]) != availableColors.end()) {
-					color = (*program)[regName];
+			state[n] = COLORED;
+			// prefer the color of the other end of a split, then of a move that was
+			// not coalesced (so it becomes "mv x, x"), then callee-save registers
+			for (auto r : partners[n]) {
+				int r_alias = getAlias(r);
+				if ((state[r_alias] == COLORED || state[r_alias] == PRECOLORED) && colorBit[color[r_alias]] >= 0
+					&& (availableColors >> colorBit[color[r_alias]] & 1)) {
+					color[n] = color[r_alias];
 					break;
 				}
-			if (color == nullptr)     // try to find callersave registers
-				for (auto regName : RISCVConfig::callerSaveRegNames)
-					if (availableColors.find((*program)[regName]) != availableColors.end()) {
-						color = (*program)[regName];
+			}
+			if (color[n] < 0)
+				for (auto m : moveList[n]) {
+					int x = getAlias(id(moves[m]->getRs1())), y = getAlias(id(moves[m]->getRd()));
+					int r = (x == n) ? y : x;
+					if ((state[r] == COLORED || state[r] == PRECOLORED) && colorBit[color[r]] >= 0
+						&& (availableColors >> colorBit[color[r]] & 1)) {
+						color[n] = color[r];
+						break;
+					}
+				}
+			if (color[n] < 0)
+				for (auto c : colorOrder)
+					if (colorBit[c] >= 0 && (availableColors >> colorBit[c] & 1)) {
+						color[n] = c;
 						break;
 					}
 
-			if (color == nullptr)
+			if (color[n] < 0)
 				throw Error("unblievable");
-			reg->info().color = color;
 		}
 	}
 
-	for (auto r : coalesced) r->info().color = getAlias(r)->info().color;
+	for (size_t n = preColored.size(); n < nodes.size(); n++) {
+		if (state[n] == COALESCED) color[n] = color[getAlias(n)];
+		if (color[n] >= 0) nodes[n]->info().color = preColored[color[n]];
+	}
 }
 
 void RegisterAllocator::rewrite()
 {
-	for (auto reg : spilled)
-		reg->info().spilladdr = std::make_shared<StackLocation>(f,
-		(*program)["sp"], f->stackLocationFromBottom(Configuration::SIZE_OF_INT), false);
+	for (auto n : spilled) {
+		if (rematDef[n] != nullptr) nodes[n]->info().remat = rematDef[n];
+		else nodes[n]->info().spilladdr = newSpillSlot(f, (*program)["sp"]);
+	}
+	insertSpillCode(f, isForSpill);
+}
+
+void RegisterAllocator::apply()
+{
+	applyColoring(f);
+}
 
+void insertSpillCode(std::shared_ptr<RISCVFunction> f, std::map<std::shared_ptr<Register>, bool> &isForSpill)
+{
 	for (auto b : f->getBlockList()) {
 
-		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+		std::shared_ptr<RISCVinstruction> next;
+		for (auto i = b->getFront(); i != nullptr; i = next) {
+			next = i->getNextInstr();
+
+			// a rematerialized value is recomputed before each use, so its only definition goes away
+			if (i->getDefReg() != nullptr && i->getDefReg()->info().remat == i) {
+				removeRISCVinstruction(i);
+				continue;
+			}
 
 			auto useRegs = i->getUseReg();
 			if (useRegs.size() == 2 && useRegs[1] == useRegs[0]) useRegs.pop_back();
-			
+
 			for(auto reg : useRegs)
-				if (reg->info().spilladdr != nullptr) {
+				if (reg->info().remat != nullptr) {
+					auto temp = std::make_shared<VirtualReg>(Operand::REG_VAL, "remat");
+					isForSpill[temp] = true;
+					auto remat = reg->info().remat;
+					if (remat->category() == RISCVinstruction::LI)
+						appendBefore(i, std::make_shared<LoadImm>(i->getBlock(), temp,
+							std::static_pointer_cast<LoadImm>(remat)->getImm()));
+					else
+						appendBefore(i, std::make_shared<LoadAddr>(i->getBlock(), temp,
+							std::static_pointer_cast<LoadAddr>(remat)->getSymbol()));
+					i->updateUseReg(reg, temp);
+				}
+				else if (reg->info().spilladdr != nullptr) {
 					auto temp = std::make_shared<VirtualReg>(Operand::REG_VAL,"spillUse");
 					isForSpill[temp] = true;
 					auto load = std::make_shared<Load>(i->getBlock(), reg->info().spilladdr, temp, Configuration::SIZE_OF_INT);
@@ -283,7 +433,7 @@ void RegisterAllocator::rewrite()
 					i->updateUseReg(reg, temp);
 
 					if (i->getDefReg() == reg) {
-						appendAfter(i, std::make_shared<Store>(i->getBlock(), 
+						appendAfter(i, std::make_shared<Store>(i->getBlock(),
 							reg->info().spilladdr, temp, Configuration::SIZE_OF_INT));
 						i->updateDefReg(temp);
 					}
@@ -305,7 +455,29 @@ void RegisterAllocator::rewrite()
 	}
 }
 
-void RegisterAllocator::apply()   // apply the current coloring
+std::map<std::shared_ptr<Register>, std::shared_ptr<RISCVinstruction> > findRematerializable(std::shared_ptr<RISCVFunction> f)
+{
+	std::map<std::shared_ptr<Register>, std::shared_ptr<RISCVinstruction> > remat;
+	std::set<std::shared_ptr<Register> > defined;
+	for (auto b : f->getBlockList())
+		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
+			auto def = i->getDefReg();
+			if (def == nullptr || def->category() == Operand::PHISICAL) continue;
+			if (defined.insert(def).second && (i->category() == RISCVinstruction::LI || i->category() == RISCVinstruction::LA))
+				remat[def] = i;
+			else remat.erase(def);
+		}
+	return remat;
+}
+
+std::shared_ptr<StackLocation> newSpillSlot(std::shared_ptr<RISCVFunction> f, std::shared_ptr<PhysicalRegister> sp)
+{
+	auto slot = std::make_shared<StackLocation>(f, sp, f->stackLocationFromBottom(Configuration::SIZE_OF_INT), false);
+	f->addSpillSlot(slot);
+	return slot;
+}
+
+void applyColoring(std::shared_ptr<RISCVFunction> f)
 {
 	for(auto b : f->getBlockList())
 		for (auto i = b->getFront(); i != nullptr; i = i->getNextInstr()) {
@@ -321,149 +493,148 @@ void RegisterAllocator::apply()   // apply the current coloring
 		}
 }
 
-void RegisterAllocator::clear()
+int RegisterAllocator::newNode(std::shared_ptr<Register> reg, NodeState s)
 {
-	initial.clear();
-	spilled.clear();
-	coalesced.clear();
-	colored.clear();
-	selectStack.clear();
-	
-	coalescedMoves.clear();
-	constrainedMoves.clear();
-	frozenMoves.clear();
-	activeMoves.clear();
-
-	spillPriority.clear();
-	
-	edges.clear();
+	int n = nodes.size();
+	reg->info().id = n;
+	nodes.push_back(reg);
+	state.push_back(s);
+	degree.push_back(s == PRECOLORED ? inf : 0);
+	alias.push_back(n);
+	color.push_back(s == PRECOLORED ? n : -1);
+	spillPriority.push_back(0);
+	adjList.emplace_back();
+	moveList.emplace_back();
+	partners.emplace_back();
+	return n;
 }
 
-void RegisterAllocator::addEdge(std::shared_ptr<Register> x, std::shared_ptr<Register> y)
+int RegisterAllocator::pop(std::vector<int> &worklist, NodeState s)
 {
-	if (x == y) return;
-	auto e1 = Edge(x, y);
-	if (edges.find(e1) != edges.end()) return;
-	edges.insert(e1);
-	edges.insert(Edge(y, x));
-	if (preColored.find(y) == preColored.end()) {
-		y->info().adjList.insert(x);
-		y->info().degree++;
+	while (!worklist.empty()) {
+		int n = worklist.back();
+		worklist.pop_back();
+		if (state[n] == s) return n;
 	}
-	if (preColored.find(x) == preColored.end()) {
-		x->info().adjList.insert(y);
-		x->info().degree++;
+	return -1;
+}
+
+int RegisterAllocator::popMove()
+{
+	while (!moveWorklist.empty()) {
+		int m = moveWorklist.back();
+		moveWorklist.pop_back();
+		if (moveState[m] == WORKLIST) return m;
 	}
+	return -1;
 }
 
-bool RegisterAllocator::isMoveRelated(std::shared_ptr<Register> reg)
+void RegisterAllocator::push(int n, NodeState s)
 {
-	return !nodeMoves(reg).empty();
+	state[n] = s;
+	if (s == SIMPLIFY) simplifyWorklist.push_back(n);
+	else if (s == FREEZE) freezeWorklist.push_back(n);
+	else if (s == SPILL) spillWorklist.push_back(n);
 }
 
-std::set<std::shared_ptr<MoveAssembly> > RegisterAllocator::nodeMoves(std::shared_ptr<Register> reg)
+void RegisterAllocator::addEdge(int x, int y)
 {
-	std::set<std::shared_ptr<MoveAssembly> > ret;
-	for (auto move : reg->info().moveList)
-		if (activeMoves.find(move) != activeMoves.end() || moveSet.find(move) != moveSet.end()) ret.insert(move);
-	return ret;
+	if (x == y) return;
+	auto k = matrixIndex(x, y);
+	if (adjMatrix.test(k)) return;
+	adjMatrix.set(k);
+	if (state[y] != PRECOLORED) {
+		adjList[y].push_back(x);
+		degree[y]++;
+	}
+	if (state[x] != PRECOLORED) {
+		adjList[x].push_back(y);
+		degree[x]++;
+	}
 }
 
-std::set<std::shared_ptr<Register>> RegisterAllocator::getNeighbors(std::shared_ptr<Register> reg)
+bool RegisterAllocator::isMoveRelated(int n)
 {
-	std::set<std::shared_ptr<Register>> ret;
-	for (auto r : reg->info().adjList)
-		if (coalesced.find(r) == coalesced.end()) ret.insert(r);
-	for (auto r : selectStack) ret.erase(r);
-	return ret;
+	for (auto m : moveList[n])
+		if (moveState[m] == ACTIVE || moveState[m] == WORKLIST) return true;
+	return false;
 }
 
-void RegisterAllocator::decreaseDegreeBy1(std::shared_ptr<Register> reg)
+void RegisterAllocator::decreaseDegreeBy1(int n)
 {
-	reg->info().degree--;
-	if (reg->info().degree == K - 1){
-		auto regs = getNeighbors(reg);
-		regs.insert(reg);
-		enableMove(regs);
+	if (state[n] == PRECOLORED) return;
+	degree[n]--;
+	if (degree[n] == K - 1){
+		enableMoves(n);
+		forEachNeighbor(n, [&](int r) { enableMoves(r); });
 
-		spillSet.erase(reg);
-		if (isMoveRelated(reg)) freezeSet.insert(reg);
-		else simplifySet.insert(reg);
+		if (state[n] == SPILL) push(n, isMoveRelated(n) ? FREEZE : SIMPLIFY);
 	}
 }
 
-void RegisterAllocator::enableMove(std::set<std::shared_ptr<Register> > regs)
+void RegisterAllocator::enableMoves(int n)
 {
-	for(auto reg : regs)
-		for(auto move : nodeMoves(reg))
-			if (activeMoves.find(move) != activeMoves.end()) { // it is active
-				activeMoves.erase(move);
-				moveSet.insert(move);
-			}
+	for (auto m : moveList[n])
+		if (moveState[m] == ACTIVE) {
+			moveState[m] = WORKLIST;
+			moveWorklist.push_back(m);
+		}
 }
 
-std::shared_ptr<Register> RegisterAllocator::getAlias(std::shared_ptr<Register> reg)
+int RegisterAllocator::getAlias(int n)
 {
-	auto r = reg;
-	while (coalesced.find(r) != coalesced.end()) r = r->info().alias;
-	return r;
+	while (state[n] == COALESCED) n = alias[n];
+	return n;
 }
 
-void RegisterAllocator::enqueue(std::shared_ptr<Register> reg)
+void RegisterAllocator::enqueue(int n)
 {
-	if (preColored.find(reg) == preColored.end() && !isMoveRelated(reg) && reg->info().degree < K) {
-		freezeSet.erase(reg);
-		simplifySet.insert(reg);
-	}
+	if (state[n] == FREEZE && !isMoveRelated(n) && degree[n] < K) push(n, SIMPLIFY);
 }
 
-bool RegisterAllocator::check(std::shared_ptr<Register> t, std::shared_ptr<Register> r)
+bool RegisterAllocator::check(int t, int r)
 {
-	return t->info().degree < K || preColored.find(t) != preColored.end() || edges.find(Edge(t, r)) != edges.end();
+	return degree[t] < K || state[t] == PRECOLORED || interferes(t, r);
 }
 
-bool RegisterAllocator::isConservative(std::set<std::shared_ptr<Register>> regs)
+bool RegisterAllocator::isConservative(int x, int y)
 {
 	int cnt = 0;
-	for (auto reg : regs)
-		if (reg->info().degree >= K) cnt++;
-
+	markStamp++;
+	auto count = [&](int r) {
+		if (mark[r] == markStamp) return;
+		mark[r] = markStamp;
+		if (degree[r] >= K) cnt++;
+	};
+	forEachNeighbor(x, count);
+	forEachNeighbor(y, count);
 	return cnt < K;
 }
 
-void RegisterAllocator::union_nodes(std::shared_ptr<Register> x, std::shared_ptr<Register> y)
+void RegisterAllocator::union_nodes(int x, int y)
 {
-	freezeSet.erase(y);
-	spillSet.erase(y);
-	coalesced.insert(y);
-	y->info().alias = x;
-	for (auto move : y->info().moveList) x->info().moveList.insert(move);
-	enableMove({ y });
+	state[y] = COALESCED;
+	alias[y] = x;
+	moveList[x].insert(moveList[x].end(), moveList[y].begin(), moveList[y].end());
+	partners[x].insert(partners[x].end(), partners[y].begin(), partners[y].end());
+	enableMoves(y);
 
-	for (auto r : getNeighbors(y)) {
+	forEachNeighbor(y, [&](int r) {
 		addEdge(r, x);
 		decreaseDegreeBy1(r);
-	}
+	});
 
-	if (x->info().degree >= K && freezeSet.find(x) != freezeSet.end()) {
-		freezeSet.erase(x);
-		spillSet.insert(x);
-	}
+	if (degree[x] >= K && state[x] == FREEZE) push(x, SPILL);
 }
 
-void RegisterAllocator::freezeMoves(std::shared_ptr<Register> r)
+void RegisterAllocator::freezeMoves(int n)
 {
-	std::shared_ptr<Register> y;
-	for (auto move : nodeMoves(r)) {
-		if (getAlias(move->getRs1()) == getAlias(r)) y = getAlias(getAlias(move->getRd()));
-		else y = getAlias(move->getRs1());
+	for (auto m : moveList[n]) {
+		if (moveState[m] != ACTIVE && moveState[m] != WORKLIST) continue;
+		int x = getAlias(id(moves[m]->getRs1())), y = getAlias(id(moves[m]->getRd()));
+		int v = (x == getAlias(n)) ? y : x;
 
-		activeMoves.erase(move);
-		frozenMoves.insert(move);
-		if (freezeSet.find(y) != freezeSet.end() && nodeMoves(y).empty()) {
-			freezeSet.erase(y);
-			simplifySet.insert(y);
-		}
+		moveState[m] = FROZEN;
+		if (state[v] == FREEZE && !isMoveRelated(v)) push(v, SIMPLIFY);
 	}
 }
- 
\ No newline at end of file
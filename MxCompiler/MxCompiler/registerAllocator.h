@@ -3,77 +3,99 @@
 #include "pch.h"
 #include "RISCVassembly.h"
 #include "configuration.h"
+#include "BitVector.h"
 #include <assert.h>
-#include <unordered_set>
 #include <unordered_map>
 
 
 
-
+/*
+Class: RegisterAllocator
+Iterated register coalescing (George & Appel).
+In every round the registers of the function are numbered densely (the
+physical ones first, c.f. RAinfo::id), liveness is computed on <BitVector>s
+and the interference graph is kept as a triangular bit matrix plus adjacency
+vectors, so a round takes time roughly linear in the size of the function.
+Spill costs are weighted by 10^(loop depth). A register defined only by a li/la
+is rematerialized instead of getting a stack slot.
+Before coloring, a value live across a call outside of its innermost loop is
+split around that call (c.f. splitAroundCalls): the copies are never coalesced,
+only preferred when picking colors, so the value may stay in a caller-save
+register inside the loop. Likewise a move that could not be coalesced
+conservatively biases the color of its ends.
+*/
 class RegisterAllocator {
 public:
-	RegisterAllocator(std::shared_ptr<RISCVProgram> _program) 
+	RegisterAllocator(std::shared_ptr<RISCVProgram> _program)
 		:program(_program) {
-		for (auto regName : RISCVConfig::physicalRegNames) {
-			preColored.insert((*program)[regName]);
-		}
+		for (auto regName : RISCVConfig::physicalRegNames)
+			preColored.push_back((*program)[regName]);
 		K = RISCVConfig::allocatableRegNames.size();
 	}
 
 	~RegisterAllocator();
 
-	using Edge = std::pair<std::shared_ptr<Register>, std::shared_ptr<Register> >;
-	
 	void run();
 
-	struct MyKeyHash
+private:
+	static const int inf = 0x3f3f3f3f;
+	static const int MAX_WEIGHTED_DEPTH = 5;
+	int K;
+
+	enum NodeState
 	{
-		size_t operator()(const Edge &k) const noexcept
-		{
-			return std::hash<std::shared_ptr<Register> >()(k.first) ^ std::hash<std::shared_ptr<Register> >()(k.second);
-		}
+		PRECOLORED, INITIAL, SIMPLIFY, FREEZE, SPILL,
+		SPILLED, COALESCED, COLORED, SELECTED
 	};
-
-	struct MyKeyHashComparator
+	enum MoveState
 	{
-		bool operator()(const Edge &k1, const Edge &k2) const noexcept
-		{
-			return k1 == k2;
-		}
+		WORKLIST, ACTIVE, COALESCED_MOVE, CONSTRAINED, FROZEN
 	};
 
-private:
-	static const int inf = 0x3f3f3f3f;
-	int K;
-
 	std::shared_ptr<RISCVProgram> program;
+	std::vector<std::shared_ptr<PhysicalRegister> > preColored;
+
+	// nodes, indexed by RAinfo::id
+	std::vector<std::shared_ptr<Register> > nodes;
+	std::vector<NodeState> state;
+	std::vector<int> degree, alias, color;
+	std::vector<double> spillPriority;
+	std::vector<std::shared_ptr<RISCVinstruction> > rematDef;
+	std::vector<std::vector<int> > adjList, moveList;
+	std::vector<std::vector<int> > partners;  // ends of split moves, whose colors are preferred
+	BitVector adjMatrix;  // the lower triangle, c.f. matrixIndex()
+
+	// the worklists may hold stale entries: a node is only taken if its state still matches
+	std::vector<int> simplifyWorklist, freezeWorklist, spillWorklist, selectStack, spilled;
 
-	std::unordered_set<std::shared_ptr<Register> > preColored, initial, 
-		simplifySet, freezeSet, spillSet,
-		spilled, coalesced, colored;
-	
-	std::set<std::shared_ptr<MoveAssembly> >
-		coalescedMoves, constrainedMoves, frozenMoves, activeMoves, moveSet;
+	std::vector<std::shared_ptr<MoveAssembly> > moves;
+	std::vector<MoveState> moveState;
+	std::vector<int> moveWorklist;
 
-	std::unordered_map<std::shared_ptr<RISCVBasicBlock>,
-		std::set<std::shared_ptr<Register> > > livein, liveout, def, use;
+	// liveness, indexed by the position in the block list
+	std::unordered_map<RISCVBasicBlock *, int> blockIndex;
+	std::vector<BitVector> livein, liveout, def, use;
 
 	// spill
 	std::map<std::shared_ptr<Register>, bool> isForSpill;
-	std::map<std::shared_ptr<Register>, int> spillPriority;
+	std::set<std::shared_ptr<RISCVinstruction> > splitMoves;
 
-	std::vector<std::shared_ptr<Register> > selectStack;
+	// colors are ids of physical registers, tried in this order
+	std::vector<int> colorOrder;
+	std::vector<int> colorBit;
 
-	std::unordered_set<Edge, MyKeyHash, MyKeyHashComparator> edges;
-	
+	std::vector<int> mark;  // for de-duplicating neighbor sets
+	int markStamp;
+
+	void splitAroundCalls();
 	void init();
 	void buildInferenceGraph();
 	void livenessAnalysis();
 	void collect();
-	void simplify();
-	void coalesce();
-	void freeze();
-	void select();
+	void simplify(int n);
+	void coalesce(int m);
+	void freeze(int n);
+	bool select();
 	void assignColor();
 	void rewrite();
 	void apply();
@@ -81,30 +103,53 @@ private:
 	std::shared_ptr<RISCVFunction> f;
 
 	/***************************** helper functions******************************/
-	void clear();
-
-	void addEdge(std::shared_ptr<Register> x, std::shared_ptr<Register> y);
+	int id(std::shared_ptr<Register> reg) { return reg->info().id; }
+	int newNode(std::shared_ptr<Register> reg, NodeState s);
+	int pop(std::vector<int> &worklist, NodeState s);
+	int popMove();
+	void push(int n, NodeState s);
+
+	size_t matrixIndex(int x, int y) {
+		if (x < y) std::swap(x, y);
+		return (size_t)x * (x - 1) / 2 + y;
+	}
+	bool interferes(int x, int y) { return x != y && adjMatrix.test(matrixIndex(x, y)); }
+	void addEdge(int x, int y);
 
-	bool isMoveRelated(std::shared_ptr<Register> reg);
+	bool isMoveRelated(int n);
 
-	std::set<std::shared_ptr<MoveAssembly> > nodeMoves(std::shared_ptr<Register> reg);
+	// calls g for every neighbor still in the graph
+	template<class F> void forEachNeighbor(int n, F g) {
+		for (auto r : adjList[n])
+			if (state[r] != SELECTED && state[r] != COALESCED) g(r);
+	}
 
-	std::set<std::shared_ptr<Register> > getNeighbors(std::shared_ptr<Register> reg);
+	void decreaseDegreeBy1(int n);
 
-	void decreaseDegreeBy1(std::shared_ptr<Register> reg);
+	void enableMoves(int n);
 
-	void enableMove(std::set<std::shared_ptr<Register> > regs);
+	int getAlias(int n);
 
-	std::shared_ptr<Register> getAlias(std::shared_ptr<Register> reg);
+	void enqueue(int n);
 
-	void enqueue(std::shared_ptr<Register> reg);
+	bool check(int t, int r);
 
-	bool check(std::shared_ptr<Register> t, std::shared_ptr<Register> r);
+	bool isConservative(int x, int y);
 
-	bool isConservative(std::set<std::shared_ptr<Register> > regs);
+	void union_nodes(int x, int y);
 
-	void union_nodes(std::shared_ptr<Register> x, std::shared_ptr<Register> y);
+	void freezeMoves(int n);
 
-	void freezeMoves(std::shared_ptr<Register> r);
+};
 
-};
\ No newline at end of file
+// Shared with <LinearScanAllocator>:
+// replaces every register with RAinfo::spilladdr set by a short-lived temporary
+// (loaded before each use and stored after each def), marked in <isForSpill>;
+// a register with RAinfo::remat set is recomputed before each use instead
+void insertSpillCode(std::shared_ptr<RISCVFunction> f, std::map<std::shared_ptr<Register>, bool> &isForSpill);
+// a fresh word on the stack of <f>, c.f. <StackSlotAllocator>
+std::shared_ptr<StackLocation> newSpillSlot(std::shared_ptr<RISCVFunction> f, std::shared_ptr<PhysicalRegister> sp);
+// the virtual registers whose only definition is a li or la
+std::map<std::shared_ptr<Register>, std::shared_ptr<RISCVinstruction> > findRematerializable(std::shared_ptr<RISCVFunction> f);
+// rewrites every virtual register to its RAinfo::color
+void applyColoring(std::shared_ptr<RISCVFunction> f);
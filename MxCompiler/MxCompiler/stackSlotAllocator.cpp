@@ -0,0 +1,123 @@
+#include "stackSlotAllocator.h"
+#include <algorithm>
+#include <cmath>
+
+void StackSlotAllocator::run()
+{
+	for (auto &function : program->getFunctions()) {
+		f = function;
+		if (f->getSpillSlots().empty()) continue;
+		f->computeLoopDepth();
+		computeInterference();
+		layout();
+	}
+}
+
+void StackSlotAllocator::computeInterference()
+{
+	auto &slots = f->getSpillSlots();
+	size_t N = slots.size();
+	slotIndex.clear();
+	for (size_t s = 0; s < N; s++) slotIndex[slots[s].get()] = s;
+	weight.assign(N, 0);
+	interference.assign(N, BitVector(N));
+
+	// a store defines the slot and a load uses it
+	auto &blocks = f->getBlockList();
+	size_t n = blocks.size();
+	std::unordered_map<RISCVBasicBlock *, int> blockIndex;
+	for (size_t bi = 0; bi < n; bi++) blockIndex[blocks[bi].get()] = bi;
+	std::vector<BitVector> livein(n, BitVector(N)), liveout(n, BitVector(N)), def(n, BitVector(N)), use(n, BitVector(N));
+	for (size_t bi = 0; bi < n; bi++) {
+		double w = std::pow(10, std::min(blocks[bi]->getLoopDepth(), (int)MAX_WEIGHTED_DEPTH));
+		for (auto i = blocks[bi]->getFront(); i != nullptr; i = i->getNextInstr()) {
+			int s = slotOf(i);
+			if (s < 0) continue;
+			weight[s] += w;
+			if (i->category() == RISCVinstruction::STORE) def[bi].set(s);
+			else if (!def[bi].test(s)) use[bi].set(s);
+		}
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t k = n; k-- > 0;) {
+			for (auto &bb : blocks[k]->getToBlocks()) liveout[k].unionWith(livein[blockIndex[bb.get()]]);
+			BitVector in = liveout[k];
+			in.subtract(def[k]);
+			in.unionWith(use[k]);
+			if (in != livein[k]) {
+				livein[k] = std::move(in);
+				changed = true;
+			}
+		}
+	}
+
+	for (size_t bi = 0; bi < n; bi++) {
+		auto live = liveout[bi];
+		for (auto i = blocks[bi]->getBack(); i != nullptr; i = i->getPrevInstr()) {
+			int s = slotOf(i);
+			if (s < 0) continue;
+			if (i->category() == RISCVinstruction::STORE) {
+				live.forEach([&](size_t t) {
+					if ((int)t != s) {
+						interference[s].set(t);
+						interference[t].set(s);
+					}
+				});
+				live.reset(s);
+			}
+			else live.set(s);
+		}
+	}
+}
+
+void StackSlotAllocator::layout()
+{
+	auto &slots = f->getSpillSlots();
+	int N = slots.size();
+	std::vector<int> order(N);
+	for (int s = 0; s < N; s++) order[s] = s;
+	std::stable_sort(order.begin(), order.end(), [&](int x, int y) { return weight[x] > weight[y]; });
+
+	// greedy coloring, every color is one word of the frame
+	std::vector<int> color(N, -1);
+	std::vector<double> colorWeight;
+	std::vector<bool> taken;
+	for (auto s : order) {
+		if (weight[s] == 0) continue;  // its backup was deleted, c.f. FrameLowering
+		taken.assign(colorWeight.size(), false);
+		interference[s].forEach([&](size_t t) { if (color[t] >= 0) taken[color[t]] = true; });
+		int c = std::find(taken.begin(), taken.end(), false) - taken.begin();
+		if (c == (int)colorWeight.size()) colorWeight.push_back(0);
+		color[s] = c;
+		colorWeight[c] += weight[s];
+	}
+
+	int C = colorWeight.size();
+	std::vector<int> rank(C);
+	for (int c = 0; c < C; c++) rank[c] = c;
+	std::stable_sort(rank.begin(), rank.end(), [&](int x, int y) { return colorWeight[x] > colorWeight[y]; });
+	std::vector<int> position(C);
+	for (int k = 0; k < C; k++) position[rank[k]] = k;
+
+	// the words right above the outgoing arguments
+	int base = f->getStackSizeFromTop();
+	for (int s = 0; s < N; s++) {
+		if (color[s] < 0) continue;
+		slots[s]->setTopDown(true);
+		slots[s]->setOffset(base + position[color[s]] * Configuration::SIZE_OF_INT);
+	}
+	f->setStackSizeFromBottom(C * Configuration::SIZE_OF_INT);
+}
+
+int StackSlotAllocator::slotOf(std::shared_ptr<RISCVinstruction> i)
+{
+	std::shared_ptr<Address> addr;
+	if (i->category() == RISCVinstruction::LOAD) addr = std::static_pointer_cast<Load>(i)->getAddr();
+	else if (i->category() == RISCVinstruction::STORE) addr = std::static_pointer_cast<Store>(i)->getAddr();
+	if (addr == nullptr || addr->category() != Operand::STACK) return -1;
+	auto it = slotIndex.find(static_cast<StackLocation *>(addr.get()));
+	return it == slotIndex.end() ? -1 : it->second;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "pch.h"
+#include "RISCVassembly.h"
+#include "configuration.h"
+#include "BitVector.h"
+#include <unordered_map>
+
+/*
+Class: StackSlotAllocator
+Runs after register allocation and lays out the spill slots of every function.
+A slot is live from a store to it until its last load, so two slots that are
+never live at the same time can share a word of the frame. Slots are colored
+greedily, the most accessed (weighted by 10^(loop depth)) first, and the
+shared words are placed right above the outgoing arguments in the same order,
+so the hot ones get the smallest offsets from sp.
+*/
+class StackSlotAllocator {
+public:
+	StackSlotAllocator(std::shared_ptr<RISCVProgram> _program) :program(_program) {}
+
+	void run();
+
+private:
+	static const int MAX_WEIGHTED_DEPTH = 5;
+
+	std::shared_ptr<RISCVProgram> program;
+	std::shared_ptr<RISCVFunction> f;
+
+	// slots, indexed in the order of RISCVFunction::getSpillSlots
+	std::unordered_map<StackLocation *, int> slotIndex;
+	std::vector<double> weight;
+	std::vector<BitVector> interference;
+
+	void computeInterference();
+	void layout();
+
+	// the slot accessed by a load or store, -1 if there is none
+	int slotOf(std::shared_ptr<RISCVinstruction> i);
+};
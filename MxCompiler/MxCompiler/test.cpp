@@ -43,12 +43,12 @@ void Test::runAndPrintIRCode(std::string src)
 	std::clog << "FINISHED\n";
 }
 
-void Test::runWithInterpreter(std::string src)
+void Test::runWithInterpreter(std::string src, bool fromText)
 {
 	MxCompiler compiler("test/" + src);
 	try
 	{
-		compiler.compile(optimize);
+		compiler.compile(optimize ? MxCompiler::O2 : MxCompiler::O0, fromText);
 	}
 	catch (Error & err)
 	{
@@ -58,17 +58,20 @@ void Test::runWithInterpreter(std::string src)
 	}
 	std::cout << "COMPILE FINISHED\n";
 
-	std::ifstream fin("ir.mxx");
-	IR_Interpreter I(fin);
-	I.run();
-	fin.close();
+	if (fromText) {
+		std::ifstream fin("ir.mxx");
+		IR_Interpreter I(fin);
+		I.run();
+		fin.close();
+	}
+	else IR_Interpreter(compiler.getIR()).run();
 }
 
 bool Test::compile(std::string src) {
 	MxCompiler compiler(src);
 	try
 	{
-		compiler.compile(optimize);
+		compiler.compile(optimize ? MxCompiler::O2 : MxCompiler::O0);
 	}
 	catch (Error & err)
 	{
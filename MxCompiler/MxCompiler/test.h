@@ -13,7 +13,8 @@ public:
 	void test1();
 	bool runTestCase(std::string src);
 	void runAndPrintIRCode(std::string src);
-	void runWithInterpreter(std::string src);
+	// <fromText>: run the printed ir.mxx instead of the in-memory IR
+	void runWithInterpreter(std::string src, bool fromText = false);
 
 private:
 
@@ -1,5 +1,35 @@
 #include "vm.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+MemoryManager::MemoryManager(bool _boundsCheck)
+	:top(ALIGN), committed(0), boundsCheck(_boundsCheck)
+{
+	// reserve the address space only, pages are committed in grow()
+#ifdef _WIN32
+	arena = static_cast<Byte *>(VirtualAlloc(nullptr, ARENA_LIMIT, MEM_RESERVE, PAGE_NOACCESS));
+	if (arena == nullptr) throw Error("VM: failed to reserve the heap");
+#else
+	void *p = mmap(nullptr, ARENA_LIMIT, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) throw Error("VM: failed to reserve the heap");
+	arena = static_cast<Byte *>(p);
+#endif
+	grow(top);
+}
+
+MemoryManager::~MemoryManager()
+{
+#ifdef _WIN32
+	VirtualFree(arena, 0, MEM_RELEASE);
+#else
+	munmap(arena, ARENA_LIMIT);
+#endif
+}
+
 int MemoryManager::getRegValue(const std::string & name)
 {
 	return regs[name];
@@ -10,32 +40,66 @@ void MemoryManager::setRegValue(const std::string & name, int v)
 	regs[name] = v;
 }
 
-int MemoryManager::load(int addr)
+int MemoryManager::allocate_memory(int size)
 {
-	return *reinterpret_cast<int *>(addr);
+	if (size < 0) throw Error("VM: allocating " + std::to_string(size) + " bytes");
+	int need = (size + HEADER + ALIGN - 1) / ALIGN * ALIGN;
+	int block = -1;
+
+	if (need <= SMALL_LIMIT) {
+		auto &list = smallFree[need / ALIGN];
+		if (!list.empty()) {
+			block = list.back();
+			list.pop_back();
+		}
+	}
+	else {
+		auto it = largeFree.lower_bound(need);
+		if (it != largeFree.end()) {
+			need = it->first;   // keep the whole block, its header still holds the size
+			block = it->second;
+			largeFree.erase(it);
+		}
+	}
+
+	if (block == -1) {   // fresh pages are already zeroed
+		if (need > ARENA_LIMIT - top) throw Error("VM: out of memory");
+		block = top;
+		grow(top + need);
+		top += need;
+		std::memcpy(arena + block, &need, HEADER);
+	}
+	else std::memset(arena + block + HEADER, 0, need - HEADER);
+	return block + HEADER;
 }
 
-void MemoryManager::store(int addr, int v)
+void MemoryManager::free_memory(int addr)
 {
-	*reinterpret_cast<int *>(addr) = v;
+	if (addr == 0) return;
+	check(addr, 0);
+	int block = addr - HEADER, size;
+	std::memcpy(&size, arena + block, HEADER);
+	if (size <= SMALL_LIMIT) smallFree[size / ALIGN].push_back(block);
+	else largeFree.emplace(size, block);
 }
 
-Byte MemoryManager::loadByte(int addr)
+void MemoryManager::grow(int newTop)
 {
-	return *reinterpret_cast<Byte *>(addr);
+	if (newTop <= committed) return;
+	int size = (newTop + COMMIT_UNIT - 1) / COMMIT_UNIT * COMMIT_UNIT;
+	if (size > ARENA_LIMIT) size = ARENA_LIMIT;
+#ifdef _WIN32
+	if (VirtualAlloc(arena + committed, size - committed, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+		throw Error("VM: out of memory");
+#else
+	if (mprotect(arena + committed, size - committed, PROT_READ | PROT_WRITE) != 0)
+		throw Error("VM: out of memory");
+#endif
+	committed = size;
 }
 
-Byte *MemoryManager::allocate_memory(int size)
+void MemoryManager::check(int addr, int size)
 {
-	if (used + size > poolSize) {
-		while (poolSize < size) poolSize <<= 1;
-		mem = new Byte[poolSize];
-		memPools.push_back(mem);
-		used = 0;
-	}
-	Byte *ret = mem + used;
-	used += size;
-	return ret;
+	if (addr < ALIGN + HEADER || addr > top - size)
+		throw Error("VM: invalid memory access at " + std::to_string(addr));
 }
-
-
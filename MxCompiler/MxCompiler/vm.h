@@ -1,6 +1,7 @@
 #pragma once
 #include "pch.h"
 #include "configuration.h"
+#include <cstring>
 
 using Byte = char;
 
@@ -61,6 +62,9 @@ public:
 
 	std::shared_ptr<VMBasicBlock> getBlockByLabel(const std::string &label) { return blocks[label]; }
 	void appendBlock(std::shared_ptr<VMBasicBlock> b) { blocks[b->getLabel()] = b; }
+
+	std::map<std::string, std::shared_ptr<VMBasicBlock> > &getBlocks() { return blocks; }
+	std::vector<std::string> &getArgs() { return args; }
 private:
 	std::string name;
 	std::shared_ptr<VMBasicBlock> entry;
@@ -68,33 +72,73 @@ private:
 	std::vector<std::string> args;
 };
 
+/*
+Class: MemoryManager
+The heap of the VM is a contiguous arena owned by the manager; guest
+addresses are 32-bit offsets into it, so pointers never leave the VM and the
+interpreter runs the same on 32-bit and 64-bit hosts. Address 0 is never
+handed out, it is the null pointer of the guest.
+The arena is reserved once and committed on demand. <allocate_memory> serves
+small blocks from size-class free lists and large blocks best-fit, every
+block carries a header with its size so that <free_memory> can recycle it.
+With bounds checking enabled every access is checked against the allocated
+part of the arena.
+*/
 class MemoryManager {
 public:
 	static const int REG_SIZE = 4;
 
-	MemoryManager() :poolSize(1024), used(0){
-		mem = new Byte[poolSize];
-		memPools.push_back(mem);
-	}
+	MemoryManager(bool _boundsCheck = false);
+	~MemoryManager();
 
-	~MemoryManager() {
-		for (auto mem : memPools) delete[] mem;
-	}
+	MemoryManager(const MemoryManager &) = delete;
+	MemoryManager &operator=(const MemoryManager &) = delete;
 
 	int getRegValue(const std::string &name);
 	void setRegValue(const std::string &name, int v);
 
-	// the address should be interpreted as Byte*
-	int load(int  addr);
-	void store(int addr,int v);
-	Byte loadByte(int addr);
+	void enableBoundsCheck(bool b = true) { boundsCheck = b; }
+
+	int load(int addr) {
+		if (boundsCheck) check(addr, sizeof(int));
+		int v;
+		std::memcpy(&v, arena + addr, sizeof(int));
+		return v;
+	}
+	void store(int addr, int v) {
+		if (boundsCheck) check(addr, sizeof(int));
+		std::memcpy(arena + addr, &v, sizeof(int));
+	}
+	Byte loadByte(int addr) {
+		if (boundsCheck) check(addr, 1);
+		return arena[addr];
+	}
+
+	// host view of [addr, addr + size), valid until the next allocation
+	Byte *translate(int addr, int size) {
+		if (boundsCheck) check(addr, size);
+		return arena + addr;
+	}
 
-	Byte *allocate_memory(int size);
+	int allocate_memory(int size);
+	void free_memory(int addr);
 
+	int heapSize() { return top; }   // bytes of the arena handed out so far
 private:
-	Byte *mem;
-	std::vector<Byte *> memPools;
-	int poolSize, used;
+	static const int HEADER = 4, ALIGN = 8;
+	static const int SMALL_LIMIT = 256;   // blocks up to this size are served by size classes
+	static const int COMMIT_UNIT = 1 << 20;
+	static const int ARENA_LIMIT = 1 << 30;
+
+	Byte *arena;
+	int top, committed;   // [0, top) is handed out, [0, committed) is accessible
+	bool boundsCheck;
+
+	std::vector<int> smallFree[SMALL_LIMIT / ALIGN + 1];
+	std::multimap<int, int> largeFree;   // size -> block
+
+	void grow(int newTop);
+	void check(int addr, int size);
 
 	std::map<std::string, int> regs;  // registers
 };
\ No newline at end of file